@@ -0,0 +1,213 @@
+/*
+Copyright (c) 2019, SODAQ
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <Sodaq_R4X.h>
+#include <Sodaq_FileReader.h>
+#include <Sodaq_FileWriter.h>
+
+#define CONSOLE_STREAM   SerialUSB
+#define MODEM_STREAM     Serial1
+#define CONSOLE_BAUDRATE 115200
+#define MODEM_BAUDRATE   115200
+
+#define TEST_FILENAME    "file_benchmark"
+#define TEST_FILE_SIZE   (32L * 1024)
+
+static Sodaq_R4X r4x;
+static Sodaq_SARA_R4XX_OnOff saraR4xxOnOff;
+static Sodaq_FileReader reader(r4x);
+static Sodaq_FileWriter writer(r4x);
+
+static uint8_t buffer[4096];
+
+static const size_t blockSizes[] = { 64, 128, 256, 512, 1024, 2048, 4096 };
+
+// The size of the read() calls of the reader, independent of its block size
+#define READ_SIZE        256
+
+static void printRate(const char* name, size_t blockSize, uint32_t bytes, uint32_t duration)
+{
+    CONSOLE_STREAM.print("  ");
+    CONSOLE_STREAM.print(name);
+    CONSOLE_STREAM.print(", block ");
+    CONSOLE_STREAM.print(blockSize);
+    CONSOLE_STREAM.print(": ");
+    CONSOLE_STREAM.print(bytes);
+    CONSOLE_STREAM.print(" bytes in ");
+    CONSOLE_STREAM.print(duration);
+    CONSOLE_STREAM.print(" ms, ");
+    CONSOLE_STREAM.print(duration > 0 ? (uint32_t)((uint64_t)bytes * 1000 / duration) : 0);
+    CONSOLE_STREAM.println(" bytes/s");
+}
+
+static void fillBuffer()
+{
+    for (size_t i = 0; i < sizeof(buffer); i++) {
+        buffer[i] = i * 7;
+    }
+}
+
+/**
+ * Write the file with one writeFile() per block, which sends blocks
+ * larger than SODAQ_R4X_FILE_WRITE_CHUNK_SIZE in more commands
+ */
+static bool benchmarkWriteFile(size_t blockSize)
+{
+    r4x.deleteFile(TEST_FILENAME);
+
+    uint32_t start = millis();
+    uint32_t bytes = 0;
+
+    // writeFile() appends
+    while (bytes < TEST_FILE_SIZE) {
+        size_t size = min((uint32_t)blockSize, TEST_FILE_SIZE - bytes);
+
+        if (!r4x.writeFile(TEST_FILENAME, buffer, size)) {
+            break;
+        }
+
+        bytes += size;
+    }
+
+    printRate("writeFile", blockSize, bytes, millis() - start);
+
+    return (bytes == TEST_FILE_SIZE);
+}
+
+/**
+ * Write the file with the writer, small writes are collected in its buffer
+ */
+static bool benchmarkWriter(size_t writeSize)
+{
+    writer.open(TEST_FILENAME);
+
+    for (uint32_t offset = 0; offset < TEST_FILE_SIZE; offset += writeSize) {
+        if (writer.write(buffer, min((uint32_t)writeSize, TEST_FILE_SIZE - offset)) == 0) {
+            break;
+        }
+    }
+
+    bool result = writer.close();
+
+    printRate("Sodaq_FileWriter", writeSize, writer.getBytesWritten(), writer.getDuration());
+    CONSOLE_STREAM.print("    throughput ");
+    CONSOLE_STREAM.print(writer.getThroughput());
+    CONSOLE_STREAM.println(" bytes/s");
+
+    return result;
+}
+
+/**
+ * Read the file with one AT+URDBLOCK per block, each waiting for the
+ * previous one, as httpGetPartial() does
+ */
+static void benchmarkReadFilePartial(size_t blockSize)
+{
+    uint32_t start = millis();
+    uint32_t bytes = 0;
+    size_t size;
+
+    while (bytes < TEST_FILE_SIZE &&
+            (size = r4x.readFilePartial(TEST_FILENAME, buffer, min((uint32_t)blockSize, TEST_FILE_SIZE - bytes), bytes)) > 0) {
+        bytes += size;
+    }
+
+    printRate("readFilePartial", blockSize, bytes, millis() - start);
+}
+
+/**
+ * Read the file with the reader, the data of each block goes directly
+ * into the read() buffer
+ */
+static void benchmarkReader(size_t blockSize)
+{
+    uint32_t start = millis();
+    uint32_t bytes = 0;
+    size_t size;
+
+    reader.setBlockSize(blockSize);
+
+    if (reader.open(TEST_FILENAME)) {
+        while ((size = reader.read(buffer, READ_SIZE)) > 0) {
+            bytes += size;
+        }
+        reader.close();
+    }
+
+    printRate("Sodaq_FileReader", blockSize, bytes, millis() - start);
+}
+
+void setup()
+{
+    while ((!CONSOLE_STREAM) && (millis() < 10000)){
+        // Wait max 10 sec for the CONSOLE_STREAM to open
+    }
+
+    CONSOLE_STREAM.begin(CONSOLE_BAUDRATE);
+
+    r4x.init(&saraR4xxOnOff, MODEM_STREAM, MODEM_BAUDRATE);
+
+    // The file system does not need the network
+    if (!r4x.on()) {
+        CONSOLE_STREAM.println("The modem does not respond");
+        return;
+    }
+
+    CONSOLE_STREAM.print("File size ");
+    CONSOLE_STREAM.println(TEST_FILE_SIZE);
+
+    fillBuffer();
+
+    for (size_t i = 0; i < sizeof(blockSizes) / sizeof(blockSizes[0]); i++) {
+        benchmarkWriteFile(blockSizes[i]);
+        benchmarkWriter(blockSizes[i]);
+    }
+
+    // The last write leaves the test file for the read benchmarks
+    if (!benchmarkWriter(sizeof(buffer))) {
+        CONSOLE_STREAM.println("Could not create the test file");
+        return;
+    }
+
+    for (size_t i = 0; i < sizeof(blockSizes) / sizeof(blockSizes[0]); i++) {
+        benchmarkReadFilePartial(blockSizes[i]);
+        benchmarkReader(blockSizes[i]);
+    }
+
+    r4x.deleteFile(TEST_FILENAME);
+
+    CONSOLE_STREAM.println("Benchmark done");
+}
+
+void loop()
+{
+}
@@ -0,0 +1,307 @@
+/*
+Copyright (c) 2019, SODAQ
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <Sodaq_R4X.h>
+
+#define CONSOLE_STREAM   SerialUSB
+#define MODEM_STREAM     Serial1
+#define CONSOLE_BAUDRATE 115200
+#define MODEM_BAUDRATE   115200
+
+// Uncomment your operator
+// #define MONOGOTO
+// #define VODAFONE_LTEM
+// #define VODAFONE_NBIOT
+// #define KPN
+// #define CUSTOM
+
+#if defined(MONOGOTO)
+#define CURRENT_APN      "data.mono"
+#define CURRENT_OPERATOR SODAQ_R4X_AUTOMATIC_OPERATOR
+#define CURRENT_URAT     SODAQ_R4X_LTEM_URAT
+#define CURRENT_MNO_PROFILE MNOProfile::STANDARD_EUROPE
+#elif defined(VODAFONE_LTEM)
+#define CURRENT_APN      "live.vodafone.com"
+#define CURRENT_OPERATOR SODAQ_R4X_AUTOMATIC_OPERATOR
+#define CURRENT_URAT     SODAQ_R4X_LTEM_URAT
+#define CURRENT_MNO_PROFILE MNOProfile::VODAFONE
+#elif defined(VODAFONE_NBIOT)
+#define CURRENT_APN      "nb.inetd.gdsp"
+#define CURRENT_OPERATOR SODAQ_R4X_AUTOMATIC_OPERATOR
+#define CURRENT_URAT     SODAQ_R4X_NBIOT_URAT
+#define CURRENT_MNO_PROFILE MNOProfile::VODAFONE
+#define NBIOT_BANDMASK "524288"
+#elif defined(KPN)
+#define CURRENT_APN "ltem.internet.m2m"
+#define CURRENT_OPERATOR SODAQ_R4X_AUTOMATIC_OPERATOR
+#define CURRENT_URAT SODAQ_R4X_LTEM_URAT
+#define CURRENT_MNO_PROFILE MNOProfile::STANDARD_EUROPE
+#elif defined(CUSTOM)
+#define CURRENT_APN      "[your apn]"
+#define CURRENT_OPERATOR SODAQ_R4X_AUTOMATIC_OPERATOR
+#define CURRENT_URAT     SODAQ_R4X_LTEM_URAT
+#define CURRENT_MNO_PROFILE MNOProfile::SIM_ICCID
+#else 
+#error "Please define a operator"
+#endif
+
+
+// Returns a body of the requested size, up to 100 KB
+#define HTTP_HOST        "httpbin.org"
+#define HTTP_PORT        80
+#define HTTP_BYTES_QUERY "/bytes/"
+
+#define MAX_BLOCK_SIZE   1024
+
+// Echoes the posted body
+#define HTTP_POST_QUERY  "/post"
+#define POST_REPEAT      5
+#define POST_FILENAME    "http_benchmark_post"
+
+// Responds after the given number of seconds
+#define HTTP_DELAY_QUERY "/delay/2"
+#define WAIT_REPEAT      5
+
+#ifndef NBIOT_BANDMASK
+#define NBIOT_BANDMASK BAND_MASK_UNCHANGED
+#endif
+
+static Sodaq_R4X r4x;
+static Sodaq_SARA_R4XX_OnOff saraR4xxOnOff;
+
+static uint8_t buffer[MAX_BLOCK_SIZE];
+static uint32_t streamedBytes;
+
+static const uint32_t downloadSizes[] = { 1024, 10240, 51200, 102400 };
+
+// Both read paths are run with each block size, up to MAX_BLOCK_SIZE
+static const size_t blockSizes[] = { 512, MAX_BLOCK_SIZE };
+
+static uint32_t completedAt;
+
+static const char postBody[] = "{\"device\":\"sodaq\",\"temperature\":21.5,\"humidity\":48}";
+
+static void countBody(const uint8_t* data, size_t size, uint32_t offset)
+{
+    (void)data;
+    (void)offset;
+
+    streamedBytes += size;
+}
+
+static void printResult(const char* name, uint32_t bytes, uint32_t duration)
+{
+    CONSOLE_STREAM.print("  ");
+    CONSOLE_STREAM.print(name);
+    CONSOLE_STREAM.print(": ");
+    CONSOLE_STREAM.print(bytes);
+    CONSOLE_STREAM.print(" bytes in ");
+    CONSOLE_STREAM.print(duration);
+    CONSOLE_STREAM.println(" ms");
+}
+
+static void printDuration(const char* name, uint32_t duration)
+{
+    CONSOLE_STREAM.print("  ");
+    CONSOLE_STREAM.print(name);
+    CONSOLE_STREAM.print(": ");
+    CONSOLE_STREAM.print(duration);
+    CONSOLE_STREAM.println(" ms");
+}
+
+/**
+ * Compare reading the response from the modem file system
+ *
+ * The request is done once, then the same response file is read with
+ * httpGetHeaderSize() and httpGetPartial(), as httpGet() does, and with
+ * httpStreamResponse(). Both are run with the same block sizes, so the
+ * difference is not caused by the size of the reads.
+ */
+static void benchmarkDownload(uint32_t size)
+{
+    char query[32];
+    snprintf(query, sizeof(query), HTTP_BYTES_QUERY "%lu", (unsigned long)size);
+
+    CONSOLE_STREAM.print("Body size ");
+    CONSOLE_STREAM.println(size);
+
+    uint32_t start = millis();
+    uint32_t fileSize = r4x.httpRequest(HTTP_HOST, HTTP_PORT, query);
+    printResult("request", fileSize, millis() - start);
+
+    if (fileSize == 0) {
+        return;
+    }
+
+    for (size_t i = 0; i < sizeof(blockSizes) / sizeof(blockSizes[0]); i++) {
+        size_t blockSize = blockSizes[i];
+
+        CONSOLE_STREAM.print(" Block size ");
+        CONSOLE_STREAM.println(blockSize);
+
+        start = millis();
+        uint32_t headerSize = r4x.httpGetHeaderSize("http_last_response_0");
+        uint32_t bytes = 0;
+        size_t chunk;
+        while ((headerSize > 0) && (chunk = r4x.httpGetPartial(buffer, min((uint32_t)blockSize, fileSize - headerSize - bytes), bytes)) > 0) {
+            bytes += chunk;
+        }
+        printResult("httpGetPartial", bytes, millis() - start);
+
+        start = millis();
+        streamedBytes = 0;
+        r4x.httpStreamResponse(countBody, buffer, blockSize);
+        printResult("httpStreamResponse", streamedBytes, millis() - start);
+    }
+}
+
+/**
+ * Compare sending a small POST body in the AT+UHTTPC command with a file
+ *
+ * httpPost() sends a body up to SODAQ_R4X_HTTP_INLINE_POST_SIZE in the
+ * command. The file path first needs AT+UDELFILE and AT+UDWNFILE, two
+ * more round trips and a write to the modem file system.
+ */
+static void benchmarkPost()
+{
+    CONSOLE_STREAM.print("POST body size ");
+    CONSOLE_STREAM.println(sizeof(postBody) - 1);
+
+    r4x.httpSetContentType(HttpContentJson);
+
+    uint32_t start = millis();
+    uint32_t bytes = 0;
+    for (uint8_t i = 0; i < POST_REPEAT; i++) {
+        bytes += r4x.httpPost(HTTP_HOST, HTTP_PORT, HTTP_POST_QUERY, NULL, 0, postBody, sizeof(postBody) - 1);
+    }
+    printResult("httpPost, inline", bytes / POST_REPEAT, (millis() - start) / POST_REPEAT);
+
+    start = millis();
+    bytes = 0;
+    for (uint8_t i = 0; i < POST_REPEAT; i++) {
+        r4x.deleteFile(POST_FILENAME);
+        r4x.writeFile(POST_FILENAME, (const uint8_t*)postBody, sizeof(postBody) - 1);
+        bytes += r4x.httpPostFromFile(HTTP_HOST, HTTP_PORT, HTTP_POST_QUERY, NULL, 0, POST_FILENAME);
+    }
+    printResult("httpPostFromFile", bytes / POST_REPEAT, (millis() - start) / POST_REPEAT);
+
+    r4x.deleteFile(POST_FILENAME);
+}
+
+static void onCompletion(uint8_t profile, bool success)
+{
+    (void)profile;
+    (void)success;
+
+    completedAt = millis();
+}
+
+/**
+ * Compare waiting for the +UUHTTPCR URC with polling the modem
+ *
+ * httpWaitForRequest() reads the URC as soon as it arrives. The polling
+ * loop sends AT with a growing delay, like the library used to, so the
+ * URC is only seen at the next poll.
+ */
+static void benchmarkWait()
+{
+    CONSOLE_STREAM.println("Request completion");
+
+    r4x.httpSetCompletionHandler(onCompletion);
+
+    uint32_t total = 0;
+    uint32_t lag = 0;
+    for (uint8_t i = 0; i < WAIT_REPEAT; i++) {
+        uint32_t start = millis();
+        int8_t profile = r4x.httpRequestAsync(HTTP_HOST, HTTP_PORT, HTTP_DELAY_QUERY);
+        r4x.httpWaitForRequest(profile);
+        total += millis() - start;
+        lag += millis() - completedAt;
+        r4x.httpReleaseProfile(profile);
+    }
+    printDuration("httpWaitForRequest, request", total / WAIT_REPEAT);
+    printDuration("httpWaitForRequest, URC to return", lag / WAIT_REPEAT);
+
+    total = 0;
+    uint32_t polls = 0;
+    for (uint8_t i = 0; i < WAIT_REPEAT; i++) {
+        uint32_t start = millis();
+        int8_t profile = r4x.httpRequestAsync(HTTP_HOST, HTTP_PORT, HTTP_DELAY_QUERY);
+        uint32_t delay_count = 50;
+        while (r4x.httpGetRequestResult(profile) == TriBoolUndefined && millis() - start < 60000) {
+            r4x.isAlive();
+            polls++;
+            if (r4x.httpGetRequestResult(profile) != TriBoolUndefined) {
+                break;
+            }
+            delay(delay_count);
+            if (delay_count < 5000) {
+                delay_count += 250;
+            }
+        }
+        total += millis() - start;
+        r4x.httpReleaseProfile(profile);
+    }
+    printDuration("AT polling, request", total / WAIT_REPEAT);
+    CONSOLE_STREAM.print("  AT polling, commands per request: ");
+    CONSOLE_STREAM.println(polls / WAIT_REPEAT);
+
+    r4x.httpSetCompletionHandler(NULL);
+}
+
+void setup()
+{
+    while ((!CONSOLE_STREAM) && (millis() < 10000)){
+        // Wait max 10 sec for the CONSOLE_STREAM to open
+    }
+
+    CONSOLE_STREAM.begin(CONSOLE_BAUDRATE);
+
+    r4x.init(&saraR4xxOnOff, MODEM_STREAM, MODEM_BAUDRATE);
+
+    bool isReady = r4x.connect(CURRENT_APN, CURRENT_URAT, CURRENT_MNO_PROFILE, CURRENT_OPERATOR, BAND_MASK_UNCHANGED, NBIOT_BANDMASK);
+    CONSOLE_STREAM.println(isReady ? "Network connected" : "Network connection failed");
+
+    if (isReady) {
+        for (size_t i = 0; i < sizeof(downloadSizes) / sizeof(downloadSizes[0]); i++) {
+            benchmarkDownload(downloadSizes[i]);
+        }
+
+        benchmarkPost();
+        benchmarkWait();
+    }
+
+    CONSOLE_STREAM.println("Benchmark done");
+}
+
+void loop()
+{
+}
@@ -84,6 +84,20 @@ static Sodaq_R4X r4x;
 static Sodaq_SARA_R4XX_OnOff saraR4xxOnOff;
 static bool isReady;
 
+static void handleMessage(const mqtt_message_t* msg)
+{
+    if (msg->offset == 0) {
+        CONSOLE_STREAM.print("Topic: ");
+        CONSOLE_STREAM.println(msg->topic);
+    }
+
+    CONSOLE_STREAM.write(msg->payload, msg->size);
+
+    if (msg->last) {
+        CONSOLE_STREAM.println();
+    }
+}
+
 void setup()
 {
     while ((!CONSOLE_STREAM) && (millis() < 10000)){
@@ -132,12 +146,10 @@ void loop()
         r4x.mqttLoop();
 
         if (r4x.mqttGetPendingMessages() > 0) {
-            char buffer[2048];
-            uint16_t i = r4x.mqttReadMessages(buffer, sizeof(buffer));
+            uint16_t i = r4x.mqttStreamMessages(handleMessage);
 
             CONSOLE_STREAM.print("Read messages:");
             CONSOLE_STREAM.println(i);
-            CONSOLE_STREAM.println(buffer);
         }
     }
 }
@@ -0,0 +1,209 @@
+/*
+Copyright (c) 2019, SODAQ
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <Sodaq_R4X.h>
+#include <Sodaq_MqttSn.h>
+
+#define CONSOLE_STREAM   SerialUSB
+#define MODEM_STREAM     Serial1
+#define CONSOLE_BAUDRATE 115200
+#define MODEM_BAUDRATE   115200
+
+// Uncomment your operator
+// #define MONOGOTO
+// #define VODAFONE_LTEM
+// #define VODAFONE_NBIOT
+// #define KPN
+// #define CUSTOM
+
+#if defined(MONOGOTO)
+#define CURRENT_APN      "data.mono"
+#define CURRENT_OPERATOR SODAQ_R4X_AUTOMATIC_OPERATOR
+#define CURRENT_URAT     SODAQ_R4X_LTEM_URAT
+#define CURRENT_MNO_PROFILE MNOProfile::STANDARD_EUROPE
+#elif defined(VODAFONE_LTEM)
+#define CURRENT_APN      "live.vodafone.com"
+#define CURRENT_OPERATOR SODAQ_R4X_AUTOMATIC_OPERATOR
+#define CURRENT_URAT     SODAQ_R4X_LTEM_URAT
+#define CURRENT_MNO_PROFILE MNOProfile::VODAFONE
+#elif defined(VODAFONE_NBIOT)
+#define CURRENT_APN      "nb.inetd.gdsp"
+#define CURRENT_OPERATOR SODAQ_R4X_AUTOMATIC_OPERATOR
+#define CURRENT_URAT     SODAQ_R4X_NBIOT_URAT
+#define CURRENT_MNO_PROFILE MNOProfile::VODAFONE
+#define NBIOT_BANDMASK "524288"
+#elif defined(KPN)
+#define CURRENT_APN "ltem.internet.m2m"
+#define CURRENT_OPERATOR SODAQ_R4X_AUTOMATIC_OPERATOR
+#define CURRENT_URAT SODAQ_R4X_LTEM_URAT
+#define CURRENT_MNO_PROFILE MNOProfile::STANDARD_EUROPE
+#elif defined(CUSTOM)
+#define CURRENT_APN      "[your apn]"
+#define CURRENT_OPERATOR SODAQ_R4X_AUTOMATIC_OPERATOR
+#define CURRENT_URAT     SODAQ_R4X_LTEM_URAT
+#define CURRENT_MNO_PROFILE MNOProfile::SIM_ICCID
+#else 
+#error "Please define a operator"
+#endif
+
+// The MQTT-SN gateway, for example Eclipse Paho MQTT-SN Gateway
+#define MQTTSN_GATEWAY_IP   "[your gateway ip]"
+#define MQTTSN_GATEWAY_PORT 1883
+#define MQTTSN_CLIENT_ID    "sodaq-bench"
+
+#define BENCH_TOPIC         "sodaq/bench/temperature"
+#define BENCH_COUNT         10
+#define BENCH_PAYLOAD_SIZE  16
+
+// Headers that are not counted by the MQTT-SN client
+#define UDP_IP_HEADER_SIZE  28
+#define TCP_IP_HEADER_SIZE  40
+
+#ifndef NBIOT_BANDMASK
+#define NBIOT_BANDMASK BAND_MASK_UNCHANGED
+#endif
+
+static Sodaq_R4X r4x;
+static Sodaq_SARA_R4XX_OnOff saraR4xxOnOff;
+static Sodaq_MqttSn mqttSn(r4x);
+
+/**
+ * Estimated bytes on air of the same publishes with the MQTT client of the
+ * modem (AT+UMQTTC), over TCP.
+ *
+ * The TCP traffic of the modem is not visible, so this counts one segment
+ * per MQTT packet plus an empty ACK segment for every received segment.
+ * TCP options and retransmissions are not counted.
+ */
+static uint32_t estimateUmqttBytes(size_t topicLength, size_t payloadSize, uint16_t count, uint8_t qos)
+{
+    // TCP handshake and close: SYN, SYN-ACK, ACK, FIN, ACK, FIN, ACK
+    uint32_t bytes = 7 * TCP_IP_HEADER_SIZE;
+
+    // CONNECT (fixed header, variable header, client ID), CONNACK, both ACKed
+    bytes += TCP_IP_HEADER_SIZE + 2 + 10 + 2 + strlen(MQTTSN_CLIENT_ID) + TCP_IP_HEADER_SIZE;
+    bytes += TCP_IP_HEADER_SIZE + 4 + TCP_IP_HEADER_SIZE;
+
+    // DISCONNECT
+    bytes += TCP_IP_HEADER_SIZE + 2;
+
+    // PUBLISH: fixed header, topic, packet identifier, payload
+    uint32_t publish = TCP_IP_HEADER_SIZE + 2 + 2 + topicLength + (qos > 0 ? 2 : 0) + payloadSize;
+    if (qos > 0) {
+        // PUBACK carries the ACK of the PUBLISH, then is ACKed itself
+        publish += TCP_IP_HEADER_SIZE + 4 + TCP_IP_HEADER_SIZE;
+    }
+    else {
+        publish += TCP_IP_HEADER_SIZE;
+    }
+
+    return bytes + count * publish;
+}
+
+static void runBenchmark(uint8_t qos)
+{
+    uint8_t payload[BENCH_PAYLOAD_SIZE];
+    memset(payload, 'x', sizeof(payload));
+
+    mqttSn.resetStatistics();
+
+    uint32_t start = millis();
+    uint16_t published = 0;
+
+    if (mqttSn.connect()) {
+        for (uint16_t i = 0; i < BENCH_COUNT; i++) {
+            if (mqttSn.publish(BENCH_TOPIC, payload, sizeof(payload), qos)) {
+                published++;
+            }
+        }
+        mqttSn.disconnect();
+    }
+
+    uint32_t duration = millis() - start;
+    uint32_t packets = mqttSn.getPacketsSent() + mqttSn.getPacketsReceived();
+    uint32_t snBytes = mqttSn.getBytesSent() + mqttSn.getBytesReceived() + packets * UDP_IP_HEADER_SIZE;
+    uint32_t umqttBytes = estimateUmqttBytes(strlen(BENCH_TOPIC), sizeof(payload), BENCH_COUNT, qos);
+
+    CONSOLE_STREAM.print("QoS ");
+    CONSOLE_STREAM.print(qos);
+    CONSOLE_STREAM.print(": published ");
+    CONSOLE_STREAM.print(published);
+    CONSOLE_STREAM.print("/");
+    CONSOLE_STREAM.print(BENCH_COUNT);
+    CONSOLE_STREAM.print(" in ");
+    CONSOLE_STREAM.print(duration);
+    CONSOLE_STREAM.println(" ms");
+
+    CONSOLE_STREAM.print("  MQTT-SN over UDP: ");
+    CONSOLE_STREAM.print(snBytes);
+    CONSOLE_STREAM.print(" bytes in ");
+    CONSOLE_STREAM.print(packets);
+    CONSOLE_STREAM.print(" datagrams, ");
+    CONSOLE_STREAM.print(snBytes / BENCH_COUNT);
+    CONSOLE_STREAM.println(" bytes per publish");
+
+    CONSOLE_STREAM.print("  MQTT over TCP (estimated): ");
+    CONSOLE_STREAM.print(umqttBytes);
+    CONSOLE_STREAM.print(" bytes, ");
+    CONSOLE_STREAM.print(umqttBytes / BENCH_COUNT);
+    CONSOLE_STREAM.println(" bytes per publish");
+}
+
+void setup()
+{
+    while ((!CONSOLE_STREAM) && (millis() < 10000)){
+        // Wait max 10 sec for the CONSOLE_STREAM to open
+    }
+
+    CONSOLE_STREAM.begin(CONSOLE_BAUDRATE);
+
+    r4x.setDiag(CONSOLE_STREAM);
+    r4x.init(&saraR4xxOnOff, MODEM_STREAM, MODEM_BAUDRATE);
+
+    bool isReady = r4x.connect(CURRENT_APN, CURRENT_URAT, CURRENT_MNO_PROFILE, CURRENT_OPERATOR, BAND_MASK_UNCHANGED, NBIOT_BANDMASK);
+
+    CONSOLE_STREAM.println(isReady ? "Network connected" : "Network connection failed");
+
+    if (isReady) {
+        mqttSn.setGateway(MQTTSN_GATEWAY_IP, MQTTSN_GATEWAY_PORT);
+        mqttSn.setClientId(MQTTSN_CLIENT_ID);
+
+        runBenchmark(0);
+        runBenchmark(1);
+    }
+
+    CONSOLE_STREAM.println("Benchmark done");
+}
+
+void loop()
+{
+    r4x.poll();
+}
@@ -0,0 +1,142 @@
+/*
+Copyright (c) 2019, SODAQ
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "Sodaq_FileReader.h"
+
+Sodaq_FileReader::Sodaq_FileReader(Sodaq_R4X& modem) : _modem(modem)
+{
+    _blockSize = SODAQ_FILE_READER_BLOCK_SIZE;
+
+    _filename = 0;
+    _size = 0;
+    _position = 0;
+    _blockRemaining = 0;
+    _error = false;
+}
+
+bool Sodaq_FileReader::open(const char* filename, uint32_t offset)
+{
+    close();
+
+    _filename = filename;
+    _size = 0;
+    _position = 0;
+    _error = false;
+
+    if (!_modem.getFileSize(filename, _size)) {
+        _filename = 0;
+        _size = 0;
+        return false;
+    }
+
+    _position = min(offset, _size);
+
+    return true;
+}
+
+void Sodaq_FileReader::close()
+{
+    if (_blockRemaining > 0) {
+        uint8_t buffer[32];
+
+        while (_blockRemaining > 0) {
+            size_t count = _modem.readFileBlockData(buffer, min(_blockRemaining, sizeof(buffer)));
+
+            if (count == 0) {
+                break;
+            }
+
+            _blockRemaining -= count;
+        }
+
+        if (_blockRemaining > 0 || !_modem.readFileBlockEnd()) {
+            _error = true;
+        }
+
+        _blockRemaining = 0;
+    }
+
+    _filename = 0;
+}
+
+size_t Sodaq_FileReader::read(uint8_t* buffer, size_t size)
+{
+    size_t total = 0;
+
+    if (!_filename || _error) {
+        return 0;
+    }
+
+    while (total < size) {
+        if (_blockRemaining == 0) {
+            if (_position >= _size) {
+                break;
+            }
+
+            _blockRemaining = requestBlock();
+
+            if (_blockRemaining == 0) {
+                _error = true;
+                break;
+            }
+        }
+
+        size_t count = _modem.readFileBlockData(&buffer[total], min(size - total, _blockRemaining));
+
+        total += count;
+        _position += count;
+        _blockRemaining -= count;
+
+        if (count == 0) {
+            // The rest of the reply is lost, the modem is free after its timeout
+            _blockRemaining = 0;
+            _error = true;
+            break;
+        }
+
+        if (_blockRemaining == 0 && !_modem.readFileBlockEnd()) {
+            _error = true;
+            break;
+        }
+    }
+
+    return total;
+}
+
+// Returns the size of the block, 0 on an error
+size_t Sodaq_FileReader::requestBlock()
+{
+    size_t size = min((uint32_t)_blockSize, _size - _position);
+
+    _modem.readFileBlockRequest(_filename, _position, size);
+
+    return _modem.readFileBlockHeader(size);
+}
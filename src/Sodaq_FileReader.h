@@ -0,0 +1,93 @@
+/*
+Copyright (c) 2019, SODAQ
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _SODAQ_FILEREADER_H
+#define _SODAQ_FILEREADER_H
+
+#include <stdint.h>
+
+#include "Sodaq_R4X.h"
+
+// The size of the AT+URDBLOCK requests, see examples/file_benchmark
+#ifndef SODAQ_FILE_READER_BLOCK_SIZE
+#define SODAQ_FILE_READER_BLOCK_SIZE 1024
+#endif
+
+/**
+ * Sequential reader of a file on the modem file system
+ *
+ * The file is requested in blocks of the block size, independent of the
+ * size of the read() calls. The data goes from the UART directly into the
+ * buffer of read(), there is no intermediate buffer.
+ *
+ * A block is only requested by read(), so the modem never sends data
+ * while the caller is busy: the UART has no flow control and its receive
+ * buffer is much smaller than a block.
+ *
+ * While a block is partly read no other command can be sent to the modem.
+ * After the end of a block or close() the modem is free again.
+ */
+class Sodaq_FileReader
+{
+public:
+    Sodaq_FileReader(Sodaq_R4X& modem);
+
+    void setBlockSize(size_t size) { _blockSize = (size > 0) ? size : 1; }
+
+    // The file name must stay valid until the file is closed.
+    // Returns false if the file does not exist.
+    bool open(const char* filename, uint32_t offset = 0);
+    // Reads the rest of the current block, if any
+    void close();
+
+    // Returns the number of bytes read, less than size at the end of the file or on an error
+    size_t read(uint8_t* buffer, size_t size);
+
+    uint32_t getSize() const { return _size; }
+    uint32_t getPosition() const { return _position; }
+    uint32_t available() const { return _size - _position; }
+    bool hasError() const { return _error; }
+
+private:
+    size_t   requestBlock();
+
+    Sodaq_R4X&  _modem;
+    size_t      _blockSize;
+
+    const char* _filename;
+    uint32_t    _size;
+    uint32_t    _position;
+    // Bytes of the current block that are not read from the UART yet
+    size_t      _blockRemaining;
+    bool        _error;
+};
+
+#endif /* _SODAQ_FILEREADER_H */
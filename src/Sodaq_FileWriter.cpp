@@ -0,0 +1,155 @@
+/*
+Copyright (c) 2019, SODAQ
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "Sodaq_FileWriter.h"
+
+Sodaq_FileWriter::Sodaq_FileWriter(Sodaq_R4X& modem) : _modem(modem)
+{
+    _progress = 0;
+
+    _filename = 0;
+    _written = 0;
+    _duration = 0;
+    _error = false;
+
+    _bufferLength = 0;
+}
+
+bool Sodaq_FileWriter::open(const char* filename, bool append)
+{
+    close();
+
+    _filename = filename;
+    _written = 0;
+    _duration = 0;
+    _error = false;
+
+    if (!append) {
+        // AT+UDWNFILE appends, the result is ignored as the file may not exist
+        _modem.deleteFile(filename);
+    }
+
+    return true;
+}
+
+bool Sodaq_FileWriter::close()
+{
+    bool result = flush();
+
+    _filename = 0;
+
+    return result;
+}
+
+size_t Sodaq_FileWriter::write(const uint8_t* data, size_t size)
+{
+    if (!_filename || _error) {
+        return 0;
+    }
+
+    size_t offset = 0;
+
+    while (offset < size) {
+        if (_bufferLength == 0 && size - offset >= sizeof(_buffer)) {
+            // No need to copy, the modem takes the rest in chunks
+            size_t count = size - offset;
+
+            if (!send(&data[offset], count)) {
+                return 0;
+            }
+
+            offset += count;
+            break;
+        }
+
+        size_t count = min(size - offset, sizeof(_buffer) - _bufferLength);
+
+        memcpy(&_buffer[_bufferLength], &data[offset], count);
+        _bufferLength += count;
+        offset += count;
+
+        if (_bufferLength == sizeof(_buffer) && !flush()) {
+            return 0;
+        }
+    }
+
+    return size;
+}
+
+bool Sodaq_FileWriter::flush()
+{
+    if (_error) {
+        return false;
+    }
+
+    if (_bufferLength == 0) {
+        return true;
+    }
+
+    bool result = send(_buffer, _bufferLength);
+    _bufferLength = 0;
+
+    return result;
+}
+
+uint32_t Sodaq_FileWriter::getThroughput() const
+{
+    return (_duration > 0) ? (uint32_t)((uint64_t)_written * 1000 / _duration) : 0;
+}
+
+// Sends the data in chunks, the progress is reported after each one
+bool Sodaq_FileWriter::send(const uint8_t* data, size_t size)
+{
+    size_t offset = 0;
+
+    while (offset < size) {
+        size_t chunkSize = min(size - offset, (size_t)SODAQ_R4X_FILE_WRITE_CHUNK_SIZE);
+        uint32_t start = millis();
+
+        bool result = _modem.writeFile(_filename, &data[offset], chunkSize);
+
+        _duration += millis() - start;
+
+        if (!result) {
+            _error = true;
+            return false;
+        }
+
+        offset += chunkSize;
+        _written += chunkSize;
+
+        if (_progress) {
+            _progress(_written);
+        }
+    }
+
+    return true;
+}
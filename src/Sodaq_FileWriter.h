@@ -0,0 +1,97 @@
+/*
+Copyright (c) 2019, SODAQ
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _SODAQ_FILEWRITER_H
+#define _SODAQ_FILEWRITER_H
+
+#include <stdint.h>
+
+#include "Sodaq_R4X.h"
+
+// Small writes are collected in a buffer of this size before they are sent
+#ifndef SODAQ_FILE_WRITER_BUFFER_SIZE
+#define SODAQ_FILE_WRITER_BUFFER_SIZE 512
+#endif
+
+/**
+ * Sequential writer of a file on the modem file system
+ *
+ * The file is built with AT+UDWNFILE appends, so it can be larger than
+ * the RAM. Writes smaller than the buffer are collected first, larger
+ * ones are sent directly in chunks of SODAQ_R4X_FILE_WRITE_CHUNK_SIZE.
+ * Every chunk must be confirmed by the modem, after an error nothing more
+ * is written.
+ *
+ * The time spent in the modem commands is measured, getThroughput()
+ * returns the write speed.
+ */
+class Sodaq_FileWriter
+{
+public:
+    Sodaq_FileWriter(Sodaq_R4X& modem);
+
+    // The handler is called after each chunk that the modem confirmed
+    void setProgressHandler(WriteProgressHandlerPtr progress) { _progress = progress; }
+
+    // The file name must stay valid until the file is closed.
+    // An existing file is replaced, unless append is true.
+    bool open(const char* filename, bool append = false);
+    // Writes the buffered data, returns false if any write failed
+    bool close();
+
+    // Returns size, or 0 on an error
+    size_t write(const uint8_t* data, size_t size);
+    bool flush();
+
+    // The bytes that the modem confirmed since open()
+    uint32_t getBytesWritten() const { return _written; }
+    // The time spent in the modem commands, in ms
+    uint32_t getDuration() const { return _duration; }
+    // Bytes per second
+    uint32_t getThroughput() const;
+    bool hasError() const { return _error; }
+
+private:
+    bool     send(const uint8_t* data, size_t size);
+
+    Sodaq_R4X&  _modem;
+    WriteProgressHandlerPtr _progress;
+
+    const char* _filename;
+    uint32_t    _written;
+    uint32_t    _duration;
+    bool        _error;
+
+    uint8_t     _buffer[SODAQ_FILE_WRITER_BUFFER_SIZE];
+    size_t      _bufferLength;
+};
+
+#endif /* _SODAQ_FILEWRITER_H */
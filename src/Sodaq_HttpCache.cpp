@@ -0,0 +1,189 @@
+/*
+Copyright (c) 2019, SODAQ
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "Sodaq_HttpCache.h"
+#include "Sodaq_Utils.h"
+
+// The stored entry: current response file, header size, body size and the ETag
+#define ENTRY_HEADER_SIZE 9
+
+Sodaq_HttpCache::Sodaq_HttpCache(Sodaq_R4X& modem) : _modem(modem)
+{
+    _slot = SODAQ_HTTP_CACHE_DEFAULT_SLOT;
+
+    _entryFile[0] = 0;
+    _responseFile[0][0] = 0;
+    _responseFile[1][0] = 0;
+    _current = -1;
+    _headerSize = 0;
+    _bodySize = 0;
+    _etag[0] = 0;
+    _modified = false;
+}
+
+uint16_t Sodaq_HttpCache::get(const char* server, uint16_t port, const char* endpoint, uint32_t timeout)
+{
+    setFileNames(server, port, endpoint);
+
+    if (!loadEntry()) {
+        _current = -1;
+        _etag[0] = 0;
+    }
+
+    // The server first, changing it clears the custom headers
+    if (!_modem.httpSetServer(server, port)) {
+        return 0;
+    }
+
+    bool conditional = (_current >= 0 && _etag[0] != 0);
+    if (conditional && !_modem.httpSetCustomHeader(_slot, "If-None-Match", _etag)) {
+        return 0;
+    }
+
+    // The new response goes to the file that is not cached
+    int8_t next = (_current == 0) ? 1 : 0;
+
+    uint32_t fileSize = _modem.httpGetToFile(server, port, endpoint, _responseFile[next], timeout);
+
+    if (conditional) {
+        _modem.httpClearCustomHeader(_slot);
+    }
+
+    uint32_t headerSize = (fileSize > 0) ? _modem.httpGetHeaderSize(_responseFile[next]) : 0;
+    if (headerSize == 0) {
+        return 0;
+    }
+
+    const http_response_t& response = _modem.httpGetResponse();
+
+    if (response.statusCode == 304 && _current >= 0) {
+        _modem.deleteFile(_responseFile[next]);
+        _modified = false;
+
+        return 200;
+    }
+
+    _modified = true;
+
+    if (response.statusCode == 200) {
+        if (_current >= 0) {
+            _modem.deleteFile(_responseFile[_current]);
+        }
+
+        _current = next;
+        _headerSize = headerSize;
+        _bodySize = fileSize - headerSize;
+        strncpy(_etag, response.etag, sizeof(_etag) - 1);
+        _etag[sizeof(_etag) - 1] = 0;
+
+        saveEntry();
+    }
+    else {
+        // Not cached, but readable until the next get()
+        _current = next;
+        _headerSize = headerSize;
+        _bodySize = fileSize - headerSize;
+    }
+
+    return response.statusCode;
+}
+
+size_t Sodaq_HttpCache::read(uint8_t* buffer, size_t size, uint32_t offset)
+{
+    if (_current < 0 || offset >= _bodySize) {
+        return 0;
+    }
+
+    size = min(size, (size_t)(_bodySize - offset));
+
+    return _modem.readFilePartial(_responseFile[_current], buffer, size, _headerSize + offset);
+}
+
+void Sodaq_HttpCache::remove(const char* server, uint16_t port, const char* endpoint)
+{
+    setFileNames(server, port, endpoint);
+
+    _modem.deleteFile(_entryFile);
+    _modem.deleteFile(_responseFile[0]);
+    _modem.deleteFile(_responseFile[1]);
+
+    _current = -1;
+    _bodySize = 0;
+}
+
+void Sodaq_HttpCache::setFileNames(const char* server, uint16_t port, const char* endpoint)
+{
+    uint32_t hash = fnv1a(FNV1A_INIT, server, strlen(server) + 1);
+    hash = fnv1a(hash, &port, sizeof(port));
+    hash = fnv1a(hash, endpoint, strlen(endpoint));
+
+    sprintf(_entryFile, "hc_%08lx", (unsigned long)hash);
+    sprintf(_responseFile[0], "%s_0", _entryFile);
+    sprintf(_responseFile[1], "%s_1", _entryFile);
+}
+
+bool Sodaq_HttpCache::loadEntry()
+{
+    uint8_t entry[ENTRY_HEADER_SIZE + sizeof(_etag)];
+    uint32_t filesize;
+
+    // Check the file first, readFilePartial() does not handle a missing file
+    if (!_modem.getFileSize(_entryFile, filesize) || filesize <= ENTRY_HEADER_SIZE || filesize > sizeof(entry) ||
+            _modem.readFilePartial(_entryFile, entry, filesize, 0) != filesize) {
+        return false;
+    }
+
+    _current = entry[0] & 1;
+    _headerSize = get_le32(&entry[1]);
+    _bodySize = get_le32(&entry[5]);
+
+    size_t etagSize = filesize - ENTRY_HEADER_SIZE;
+    memcpy(_etag, &entry[ENTRY_HEADER_SIZE], etagSize);
+    _etag[min(etagSize, sizeof(_etag) - 1)] = 0;
+
+    return true;
+}
+
+bool Sodaq_HttpCache::saveEntry()
+{
+    uint8_t entry[ENTRY_HEADER_SIZE + sizeof(_etag)];
+    size_t etagSize = strlen(_etag) + 1;
+
+    entry[0] = _current;
+    put_le32(&entry[1], _headerSize);
+    put_le32(&entry[5], _bodySize);
+    memcpy(&entry[ENTRY_HEADER_SIZE], _etag, etagSize);
+
+    // writeFile() appends, so the old entry is removed first
+    _modem.deleteFile(_entryFile);
+
+    return _modem.writeFile(_entryFile, entry, ENTRY_HEADER_SIZE + etagSize);
+}
@@ -0,0 +1,101 @@
+/*
+Copyright (c) 2019, SODAQ
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _SODAQ_HTTPCACHE_H
+#define _SODAQ_HTTPCACHE_H
+
+#include <stdint.h>
+
+#include "Sodaq_R4X.h"
+
+#ifndef SODAQ_HTTP_CACHE_DEFAULT_SLOT
+#define SODAQ_HTTP_CACHE_DEFAULT_SLOT 3
+#endif
+
+#if SODAQ_HTTP_CACHE_DEFAULT_SLOT == SODAQ_R4X_HTTP_INFLATE_HEADER_SLOT
+#error "The http cache and the inflater of Sodaq_R4X use the same custom header slot"
+#endif
+
+/**
+ * Conditional HTTP GET with a cache on the modem file system
+ *
+ * The last response of every URL is kept in a file on the modem, with
+ * its ETag. The next get() sends If-None-Match with that ETag in a
+ * custom header slot of http profile 0. When the server answers
+ * 304 Not Modified, the cached response is used and the body does not
+ * have to be downloaded or read again: isModified() is false.
+ *
+ * Two response files are used per URL, a new response is stored in the
+ * one that is not cached, so the cache is never copied. The files are
+ * named hc_<hash>, hc_<hash>_0 and hc_<hash>_1.
+ *
+ * If-Modified-Since is not sent: a custom header value of the modem
+ * cannot contain ':', which every HTTP date does.
+ */
+class Sodaq_HttpCache
+{
+public:
+    Sodaq_HttpCache(Sodaq_R4X& modem);
+
+    // The custom header slot [0-4] that is used for If-None-Match
+    void setHeaderSlot(uint8_t index) { _slot = index; }
+
+    // Returns the status code, 200 for a new or a cached response, or 0 if the request failed.
+    // Note. Endpoint should include the initial "/".
+    uint16_t get(const char* server, uint16_t port, const char* endpoint, uint32_t timeout = 60000);
+
+    // False if the last get() was answered from the cache
+    bool isModified() const { return _modified; }
+    uint32_t getBodySize() const { return _bodySize; }
+    // Reads the body of the last get(), offset 0 is the byte directly after the header
+    size_t read(uint8_t* buffer, size_t size, uint32_t offset = 0);
+    // Removes the cached response of the URL
+    void remove(const char* server, uint16_t port, const char* endpoint);
+
+private:
+    void     setFileNames(const char* server, uint16_t port, const char* endpoint);
+    bool     loadEntry();
+    bool     saveEntry();
+
+    Sodaq_R4X&  _modem;
+    uint8_t     _slot;
+
+    // The entry of the last URL
+    char        _entryFile[12];
+    char        _responseFile[2][14];
+    int8_t      _current;
+    uint32_t    _headerSize;
+    uint32_t    _bodySize;
+    char        _etag[SODAQ_R4X_HTTP_HEADER_VALUE_SIZE];
+    bool        _modified;
+};
+
+#endif /* _SODAQ_HTTPCACHE_H */
@@ -0,0 +1,458 @@
+/*
+Copyright (c) 2019, SODAQ
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "Sodaq_HttpClient.h"
+
+static inline bool is_timedout(uint32_t from, uint32_t nr_ms) __attribute__((always_inline));
+static inline bool is_timedout(uint32_t from, uint32_t nr_ms) { return (millis() - from) > nr_ms; }
+
+// Compare the start of a header line with a header name, case insensitive
+static const char* match_header(const char* line, const char* name)
+{
+    size_t length = strlen(name);
+
+    if (strncasecmp(line, name, length) != 0 || line[length] != ':') {
+        return 0;
+    }
+
+    const char* value = line + length + 1;
+    while (*value == ' ' || *value == '\t') {
+        value++;
+    }
+
+    return value;
+}
+
+Sodaq_HttpClient::Sodaq_HttpClient(Sodaq_R4X& modem) : _modem(modem)
+{
+    _host = 0;
+    _port = SODAQ_HTTP_CLIENT_DEFAULT_PORT;
+    _socket = -1;
+    _timeout = SODAQ_HTTP_CLIENT_DEFAULT_TIMEOUT;
+    _headers = 0;
+    _inflater = 0;
+
+    _state = StateDone;
+    _headRequest = false;
+    _statusCode = 0;
+    _keepAlive = false;
+    _chunked = false;
+    _hasContentLength = false;
+    _encoded = false;
+    _remaining = 0;
+    _bodyOffset = 0;
+    _rangeTotal = 0;
+    _handler = 0;
+
+    _lineLength = 0;
+    _txLength = 0;
+}
+
+void Sodaq_HttpClient::setServer(const char* host, uint16_t port)
+{
+    if (_host != host || _port != port) {
+        stop();
+    }
+
+    _host = host;
+    _port = port;
+}
+
+uint16_t Sodaq_HttpClient::get(const char* path, HttpBodyHandlerPtr handler)
+{
+    return request("GET", path, 0, 0, 0, handler);
+}
+
+uint16_t Sodaq_HttpClient::post(const char* path, const char* contentType, const uint8_t* body, size_t size,
+                                HttpBodyHandlerPtr handler)
+{
+    return request("POST", path, contentType, body, size, handler);
+}
+
+/**
+ * Send the request and receive the response
+ *
+ * A kept-alive connection can be closed by the server at any time. If the
+ * response does not start on a reused connection, the request is sent
+ * once more on a new connection.
+ */
+uint16_t Sodaq_HttpClient::request(const char* method, const char* path, const char* contentType,
+                                   const uint8_t* body, size_t size, HttpBodyHandlerPtr handler)
+{
+    if (_host == 0) {
+        return 0;
+    }
+
+    _headRequest = (strcmp(method, "HEAD") == 0);
+    _handler = handler;
+
+    for (uint8_t attempt = 0; attempt < 2; attempt++) {
+        bool reused = isConnected();
+
+        if (!reused && !connect()) {
+            return 0;
+        }
+
+        if (sendRequest(method, path, contentType, body, size) && receiveResponse()) {
+            if (!_keepAlive) {
+                stop();
+            }
+
+            return _statusCode;
+        }
+
+        bool started = (_state != StateStatusLine) || (_lineLength > 0);
+
+        stop();
+
+        if (!reused || started) {
+            break;
+        }
+    }
+
+    return 0;
+}
+
+bool Sodaq_HttpClient::isConnected()
+{
+    return (_socket >= 0) && !_modem.socketIsClosed(_socket);
+}
+
+void Sodaq_HttpClient::stop()
+{
+    if (_socket >= 0) {
+        _modem.socketClose(_socket);
+        _socket = -1;
+    }
+}
+
+bool Sodaq_HttpClient::connect()
+{
+    stop();
+
+    _socket = _modem.socketCreate(0, UbloxTCP);
+    if (_socket < 0) {
+        return false;
+    }
+
+    if (!_modem.socketConnect(_socket, _host, _port)) {
+        stop();
+        return false;
+    }
+
+    return true;
+}
+
+bool Sodaq_HttpClient::sendRequest(const char* method, const char* path, const char* contentType,
+                                   const uint8_t* body, size_t size)
+{
+    char number[12];
+
+    _txLength = 0;
+
+    if (!append(method) || !append(" ") || !append(path) ||
+            !append(" HTTP/1.1\r\nHost: ") || !append(_host)) {
+        return false;
+    }
+
+    if (_port != SODAQ_HTTP_CLIENT_DEFAULT_PORT) {
+        sprintf(number, ":%u", _port);
+
+        if (!append(number)) {
+            return false;
+        }
+    }
+
+    if (!append("\r\n")) {
+        return false;
+    }
+
+    if (body || strcmp(method, "POST") == 0 || strcmp(method, "PUT") == 0) {
+        if (contentType && (!append("Content-Type: ") || !append(contentType) || !append("\r\n"))) {
+            return false;
+        }
+
+        sprintf(number, "%lu", (unsigned long)size);
+
+        if (!append("Content-Length: ") || !append(number) || !append("\r\n")) {
+            return false;
+        }
+    }
+
+    if (_inflater && !append("Accept-Encoding: gzip, deflate\r\n")) {
+        return false;
+    }
+
+    if (_headers && !append(_headers)) {
+        return false;
+    }
+
+    if (!append("\r\n")) {
+        return false;
+    }
+
+    if (body && size > 0 && !append(body, size)) {
+        return false;
+    }
+
+    return flushTx();
+}
+
+// Copy the data to the transmit buffer, a full buffer is written to the socket
+bool Sodaq_HttpClient::append(const void* data, size_t size)
+{
+    const uint8_t* p = (const uint8_t*)data;
+
+    while (size > 0) {
+        if (_txLength == sizeof(_txBuffer) && !flushTx()) {
+            return false;
+        }
+
+        size_t chunkSize = min(size, sizeof(_txBuffer) - _txLength);
+
+        memcpy(&_txBuffer[_txLength], p, chunkSize);
+        _txLength += chunkSize;
+        p += chunkSize;
+        size -= chunkSize;
+    }
+
+    return true;
+}
+
+bool Sodaq_HttpClient::flushTx()
+{
+    size_t offset = 0;
+
+    while (offset < _txLength) {
+        size_t chunkSize = min(_txLength - offset, (size_t)SODAQ_MAX_SEND_MESSAGE_SIZE);
+
+        if (_modem.socketWrite(_socket, &_txBuffer[offset], chunkSize) != chunkSize) {
+            _txLength = 0;
+            return false;
+        }
+
+        offset += chunkSize;
+    }
+
+    _txLength = 0;
+
+    return true;
+}
+
+bool Sodaq_HttpClient::receiveResponse()
+{
+    _state = StateStatusLine;
+    _statusCode = 0;
+    _keepAlive = false;
+    _chunked = false;
+    _hasContentLength = false;
+    _encoded = false;
+    _remaining = 0;
+    _bodyOffset = 0;
+    _rangeTotal = 0;
+    _lineLength = 0;
+
+    uint32_t start = millis();
+
+    while (_state != StateDone && !is_timedout(start, _timeout)) {
+        if (_modem.socketWaitForRead(_socket, _timeout - (millis() - start))) {
+            size_t count = _modem.socketRead(_socket, _rxBuffer, sizeof(_rxBuffer));
+            parse(_rxBuffer, count);
+        }
+        else if (_modem.socketIsClosed(_socket)) {
+            if (_state == StateBody && !_hasContentLength) {
+                // A body without length ends when the connection closes
+                _state = StateDone;
+            }
+            break;
+        }
+    }
+
+    if (_encoded && !_inflater->isDone()) {
+        // Not valid, or the compressed stream is incomplete
+        return false;
+    }
+
+    return (_state == StateDone);
+}
+
+void Sodaq_HttpClient::parse(const uint8_t* data, size_t size)
+{
+    size_t i = 0;
+
+    while (i < size && _state != StateDone) {
+        if (_state == StateBody || _state == StateChunkData) {
+            size_t count = size - i;
+            if (_state == StateChunkData || _hasContentLength) {
+                count = min(count, (size_t)_remaining);
+                _remaining -= count;
+            }
+
+            deliver(&data[i], count);
+            i += count;
+
+            if ((_state == StateChunkData || _hasContentLength) && _remaining == 0) {
+                _state = (_state == StateChunkData) ? StateChunkEnd : StateDone;
+            }
+            continue;
+        }
+
+        // The other states are line based
+        char c = data[i++];
+
+        if (c == '\n') {
+            _line[_lineLength] = 0;
+            parseLine();
+            _lineLength = 0;
+        }
+        else if (c != '\r' && _lineLength < sizeof(_line) - 1) {
+            _line[_lineLength++] = c;
+        }
+    }
+}
+
+void Sodaq_HttpClient::parseLine()
+{
+    switch (_state) {
+    case StateStatusLine: {
+        // e.g. "HTTP/1.1 200 OK"
+        unsigned int major, minor, statusCode;
+        if (sscanf(_line, "HTTP/%u.%u %u", &major, &minor, &statusCode) == 3) {
+            _statusCode = statusCode;
+            _keepAlive = (major > 1) || (minor >= 1);
+            _state = StateHeader;
+        }
+        break;
+    }
+    case StateHeader:
+        if (_lineLength == 0) {
+            endOfHeader();
+        }
+        else {
+            parseHeaderLine();
+        }
+        break;
+    case StateChunkSize:
+        // The size is hexadecimal, extensions after ';' are ignored
+        _remaining = strtoul(_line, 0, 16);
+        _state = (_remaining > 0) ? StateChunkData : StateTrailer;
+        break;
+    case StateChunkEnd:
+        _state = StateChunkSize;
+        break;
+    case StateTrailer:
+        if (_lineLength == 0) {
+            _state = StateDone;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+void Sodaq_HttpClient::parseHeaderLine()
+{
+    const char* value;
+
+    if ((value = match_header(_line, "Content-Length"))) {
+        _hasContentLength = true;
+        _remaining = strtoul(value, 0, 10);
+    }
+    else if ((value = match_header(_line, "Content-Range"))) {
+        // e.g. "bytes 0-4095/123456", the size can be "*"
+        const char* total = strchr(value, '/');
+        _rangeTotal = total ? strtoul(total + 1, 0, 10) : 0;
+    }
+    else if ((value = match_header(_line, "Content-Encoding"))) {
+        _encoded = _inflater && (strncasecmp(value, "gzip", 4) == 0 || strncasecmp(value, "deflate", 7) == 0);
+    }
+    else if ((value = match_header(_line, "Transfer-Encoding"))) {
+        _chunked = (strstr(value, "chunked") != 0);
+    }
+    else if ((value = match_header(_line, "Connection"))) {
+        if (strncasecmp(value, "close", 5) == 0) {
+            _keepAlive = false;
+        }
+        else if (strncasecmp(value, "keep-alive", 10) == 0) {
+            _keepAlive = true;
+        }
+    }
+}
+
+void Sodaq_HttpClient::endOfHeader()
+{
+    if (_statusCode >= 100 && _statusCode < 200) {
+        // An interim response, e.g. 100 Continue, the real one follows
+        _state = StateStatusLine;
+        _hasContentLength = false;
+        _chunked = false;
+        _encoded = false;
+        return;
+    }
+
+    if (_headRequest || _statusCode == 204 || _statusCode == 304) {
+        _state = StateDone;
+    }
+    else if (_chunked) {
+        _hasContentLength = false;
+        _state = StateChunkSize;
+    }
+    else if (_hasContentLength) {
+        _state = (_remaining > 0) ? StateBody : StateDone;
+    }
+    else {
+        // The body ends when the server closes the connection
+        _keepAlive = false;
+        _state = StateBody;
+    }
+
+    if (_state == StateDone) {
+        _encoded = false;
+    }
+    else if (_encoded) {
+        // gzip, or zlib or raw deflate, which servers both send as "deflate"
+        _inflater->setSink(_handler);
+        _inflater->begin(InflateAuto);
+    }
+}
+
+void Sodaq_HttpClient::deliver(const uint8_t* data, size_t size)
+{
+    if (_encoded) {
+        // An error is kept by the inflater, the rest of the body is still read
+        _inflater->write(data, size);
+    }
+    else if (_handler && size > 0) {
+        _handler(data, size, _bodyOffset);
+    }
+
+    _bodyOffset += size;
+}
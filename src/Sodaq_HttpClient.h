@@ -0,0 +1,153 @@
+/*
+Copyright (c) 2019, SODAQ
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _SODAQ_HTTPCLIENT_H
+#define _SODAQ_HTTPCLIENT_H
+
+#include <stdint.h>
+
+#include "Sodaq_R4X.h"
+#include "Sodaq_Inflate.h"
+
+#ifndef SODAQ_HTTP_CLIENT_BUFFER_SIZE
+#define SODAQ_HTTP_CLIENT_BUFFER_SIZE     256
+#endif
+
+#define SODAQ_HTTP_CLIENT_MAX_LINE        128
+
+#define SODAQ_HTTP_CLIENT_DEFAULT_PORT    80
+#define SODAQ_HTTP_CLIENT_DEFAULT_TIMEOUT (30L * 1000)
+
+/**
+ * HTTP/1.1 client over a TCP socket of the modem
+ *
+ * Unlike the HTTP client of the modem (AT+UHTTPC), the response does not
+ * go through the file system of the modem: the body is passed to the
+ * handler while it is received. Chunked transfer encoding is decoded.
+ *
+ * The connection is kept open between requests to the same server, as
+ * long as the server allows it. A connection that the server closed in
+ * the meantime is opened again.
+ *
+ * The request is sent in blocks of SODAQ_HTTP_CLIENT_BUFFER_SIZE bytes.
+ *
+ * With an inflater, gzip and deflate encoded bodies are decompressed
+ * while they are received, the handler gets the decoded data.
+ */
+class Sodaq_HttpClient
+{
+public:
+    Sodaq_HttpClient(Sodaq_R4X& modem);
+
+    void setServer(const char* host, uint16_t port = SODAQ_HTTP_CLIENT_DEFAULT_PORT);
+    void setTimeout(uint32_t timeout) { _timeout = timeout; }
+    // Extra header lines that are sent with every request, each ending with "\r\n"
+    void setHeaders(const char* headers) { _headers = headers; }
+    // Accepts compressed responses and decodes them with the inflater, NULL to disable
+    void setInflater(Sodaq_Inflate* inflater) { _inflater = inflater; }
+
+    // The requests return the status code, or 0 if no complete response was received
+    // or an encoded body could not be decoded.
+    // The body of the response is passed to the handler, which can be NULL.
+    // Path should include the initial "/".
+    uint16_t get(const char* path, HttpBodyHandlerPtr handler);
+    uint16_t post(const char* path, const char* contentType, const uint8_t* body, size_t size,
+                  HttpBodyHandlerPtr handler);
+    uint16_t request(const char* method, const char* path, const char* contentType,
+                     const uint8_t* body, size_t size, HttpBodyHandlerPtr handler);
+
+    // The size of the body of the last response, before it is decoded
+    uint32_t getBodySize() const { return _bodyOffset; }
+    // The complete size from the Content-Range header of the last response, 0 if unknown
+    uint32_t getRangeTotal() const { return _rangeTotal; }
+
+    bool isConnected();
+    void stop();
+
+private:
+    enum ParseStates {
+        StateStatusLine = 0,
+        StateHeader,
+        StateBody,
+        StateChunkSize,
+        StateChunkData,
+        StateChunkEnd,
+        StateTrailer,
+        StateDone,
+    };
+
+    bool     connect();
+    bool     sendRequest(const char* method, const char* path, const char* contentType,
+                         const uint8_t* body, size_t size);
+    bool     receiveResponse();
+    void     parse(const uint8_t* data, size_t size);
+    void     parseLine();
+    void     parseHeaderLine();
+    void     endOfHeader();
+    void     deliver(const uint8_t* data, size_t size);
+
+    bool     append(const void* data, size_t size);
+    bool     append(const char* s) { return append(s, strlen(s)); }
+    bool     flushTx();
+
+    Sodaq_R4X&  _modem;
+
+    const char* _host;
+    uint16_t    _port;
+    int         _socket;
+    uint32_t    _timeout;
+    const char* _headers;
+    Sodaq_Inflate* _inflater;
+
+    // State of the response that is received
+    uint8_t     _state;
+    bool        _headRequest;
+    uint16_t    _statusCode;
+    bool        _keepAlive;
+    bool        _chunked;
+    bool        _hasContentLength;
+    // The body goes through the inflater
+    bool        _encoded;
+    // Bytes left of the body or the current chunk
+    uint32_t    _remaining;
+    uint32_t    _bodyOffset;
+    uint32_t    _rangeTotal;
+    HttpBodyHandlerPtr _handler;
+
+    char        _line[SODAQ_HTTP_CLIENT_MAX_LINE];
+    size_t      _lineLength;
+
+    uint8_t     _rxBuffer[SODAQ_HTTP_CLIENT_BUFFER_SIZE];
+    uint8_t     _txBuffer[SODAQ_HTTP_CLIENT_BUFFER_SIZE];
+    size_t      _txLength;
+};
+
+#endif /* _SODAQ_HTTPCLIENT_H */
@@ -0,0 +1,217 @@
+/*
+Copyright (c) 2019, SODAQ
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "Sodaq_HttpDownload.h"
+#include "Sodaq_Utils.h"
+
+// The size of the stored state: hash, offset, size and CRC
+#define STATE_SIZE 16
+
+// The body handler of the client has no context, so one download can be active at a time
+static Sodaq_HttpDownload* activeDownload;
+
+Sodaq_HttpDownload::Sodaq_HttpDownload(Sodaq_HttpClient& client, Sodaq_R4X& modem) :
+    _client(client), _modem(modem)
+{
+    _rangeSize = SODAQ_HTTP_DOWNLOAD_DEFAULT_RANGE;
+    _maxRetries = SODAQ_HTTP_DOWNLOAD_DEFAULT_RETRIES;
+    _stateFile = SODAQ_HTTP_DOWNLOAD_STATE_FILENAME;
+    _progress = 0;
+
+    _hash = 0;
+    _offset = 0;
+    _size = 0;
+    _crc = CRC32_INIT;
+    _empty = false;
+
+    _sink = 0;
+    _received = 0;
+    _rangeCrc = CRC32_INIT;
+    _rangeHeader[0] = 0;
+}
+
+bool Sodaq_HttpDownload::download(const char* path, HttpBodyHandlerPtr sink, uint32_t expectedCrc32)
+{
+    if (_rangeSize == 0) {
+        return false;
+    }
+
+    loadState(fnv1a(FNV1A_INIT, path, strlen(path)));
+
+    _sink = sink;
+    activeDownload = this;
+
+    uint8_t failures = 0;
+    bool complete = (_size > 0 && _offset >= _size);
+
+    _empty = false;
+
+    while (!complete) {
+        if (downloadRange(path)) {
+            failures = 0;
+            complete = _empty || (_size > 0 && _offset >= _size);
+
+            if (_progress) {
+                _progress(_offset, _size);
+            }
+        }
+        else if (++failures > _maxRetries) {
+            break;
+        }
+    }
+
+    _client.setHeaders(0);
+    activeDownload = 0;
+
+    if (complete && expectedCrc32 != 0 && getCrc32() != expectedCrc32) {
+        // Corrupt, start over next time
+        reset();
+        return false;
+    }
+
+    return complete;
+}
+
+void Sodaq_HttpDownload::reset()
+{
+    _modem.deleteFile(_stateFile);
+
+    _offset = 0;
+    _size = 0;
+    _crc = CRC32_INIT;
+}
+
+/**
+ * Request the next range and pass it to the sink
+ *
+ * Returns true if the range is complete, it is then added to the
+ * stored state.
+ */
+bool Sodaq_HttpDownload::downloadRange(const char* path)
+{
+    uint32_t last = _offset + _rangeSize - 1;
+    if (_size > 0 && last >= _size) {
+        last = _size - 1;
+    }
+
+    sprintf(_rangeHeader, "Range: bytes=%lu-%lu\r\n", (unsigned long)_offset, (unsigned long)last);
+    _client.setHeaders(_rangeHeader);
+
+    _received = 0;
+    _rangeCrc = _crc;
+
+    uint16_t status = _client.get(path, handleBody);
+
+    if (status == 206) {
+        if (_client.getRangeTotal() > 0) {
+            _size = _client.getRangeTotal();
+        }
+
+        // A short range is the end of a resource of unknown size
+        if (_received != last - _offset + 1 && (_size > 0 || _received == 0)) {
+            return false;
+        }
+
+        if (_size == 0 && _received < _rangeSize) {
+            _size = _offset + _received;
+        }
+    }
+    else if (status == 200 && _offset == 0) {
+        // The server ignored the range and sent everything
+        _size = _received;
+        _empty = (_received == 0);
+    }
+    else if (status == 416 && _offset > 0 && _size == 0) {
+        // The previous range ended exactly at the end
+        _size = _offset;
+        saveState();
+        return true;
+    }
+    else {
+        return false;
+    }
+
+    _offset += _received;
+    _crc = _rangeCrc;
+
+    saveState();
+
+    return true;
+}
+
+void Sodaq_HttpDownload::handleBody(const uint8_t* data, size_t size, uint32_t offset)
+{
+    Sodaq_HttpDownload* d = activeDownload;
+    if (!d) {
+        return;
+    }
+
+    if (d->_sink) {
+        d->_sink(data, size, d->_offset + offset);
+    }
+
+    d->_rangeCrc = crc32_update(d->_rangeCrc, data, size);
+    d->_received += size;
+}
+
+void Sodaq_HttpDownload::loadState(uint32_t hash)
+{
+    uint8_t state[STATE_SIZE];
+    uint32_t filesize;
+
+    // Check the file first, readFilePartial() does not handle a missing file
+    if (_modem.getFileSize(_stateFile, filesize) && (filesize == sizeof(state)) &&
+            (_modem.readFilePartial(_stateFile, state, sizeof(state), 0) == sizeof(state)) &&
+            (get_le32(&state[0]) == hash)) {
+        _hash = hash;
+        _offset = get_le32(&state[4]);
+        _size = get_le32(&state[8]);
+        _crc = get_le32(&state[12]);
+        return;
+    }
+
+    reset();
+    _hash = hash;
+}
+
+void Sodaq_HttpDownload::saveState()
+{
+    uint8_t state[STATE_SIZE];
+
+    put_le32(&state[0], _hash);
+    put_le32(&state[4], _offset);
+    put_le32(&state[8], _size);
+    put_le32(&state[12], _crc);
+
+    // writeFile() appends, so the old state is removed first
+    _modem.deleteFile(_stateFile);
+    _modem.writeFile(_stateFile, state, sizeof(state));
+}
@@ -0,0 +1,121 @@
+/*
+Copyright (c) 2019, SODAQ
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _SODAQ_HTTPDOWNLOAD_H
+#define _SODAQ_HTTPDOWNLOAD_H
+
+#include <stdint.h>
+
+#include "Sodaq_R4X.h"
+#include "Sodaq_HttpClient.h"
+
+#ifndef SODAQ_HTTP_DOWNLOAD_DEFAULT_RANGE
+#define SODAQ_HTTP_DOWNLOAD_DEFAULT_RANGE   4096
+#endif
+
+#define SODAQ_HTTP_DOWNLOAD_DEFAULT_RETRIES 3
+#define SODAQ_HTTP_DOWNLOAD_STATE_FILENAME  "http_download"
+
+// Reports the number of bytes that are downloaded and verified, size is 0 if unknown
+typedef void(*HttpDownloadProgressPtr)(uint32_t offset, uint32_t size);
+
+/**
+ * Resumable download with HTTP Range requests
+ *
+ * The resource is fetched in ranges of setRangeSize() bytes with a
+ * Sodaq_HttpClient. Every range is passed to the sink with its offset in
+ * the resource. A failed range is requested again, from its start, so
+ * the sink must accept data for the same offset more than once.
+ *
+ * After every complete range the offset and the running CRC-32 are
+ * stored in a file on the modem. A download of the same path continues
+ * from there, also after a reboot of the MCU. reset() starts over.
+ *
+ * The extra headers of the client are used for the Range header while
+ * downloading, and are cleared afterwards.
+ *
+ * A server that does not support ranges answers the first range with
+ * the complete resource, which is accepted as well.
+ */
+class Sodaq_HttpDownload
+{
+public:
+    Sodaq_HttpDownload(Sodaq_HttpClient& client, Sodaq_R4X& modem);
+
+    void setRangeSize(uint32_t size) { _rangeSize = size; }
+    void setMaxRetries(uint8_t retries) { _maxRetries = retries; }
+    void setStateFile(const char* filename) { _stateFile = filename; }
+    void setProgressHandler(HttpDownloadProgressPtr progress) { _progress = progress; }
+
+    // Downloads the path from the server of the client, or continues a previous
+    // download of it. If expectedCrc32 is not 0, it is compared with the CRC-32
+    // of the complete resource.
+    // Returns true when the resource is complete.
+    bool download(const char* path, HttpBodyHandlerPtr sink, uint32_t expectedCrc32 = 0);
+    // Forgets the stored state, the next download starts at offset 0
+    void reset();
+
+    uint32_t getOffset() const { return _offset; }
+    // The size of the resource, 0 if unknown
+    uint32_t getSize() const { return _size; }
+    // The CRC-32 of the bytes up to getOffset()
+    uint32_t getCrc32() const { return ~_crc; }
+
+private:
+    static void handleBody(const uint8_t* data, size_t size, uint32_t offset);
+
+    bool     downloadRange(const char* path);
+    void     loadState(uint32_t hash);
+    void     saveState();
+
+    Sodaq_HttpClient& _client;
+    Sodaq_R4X&  _modem;
+
+    uint32_t    _rangeSize;
+    uint8_t     _maxRetries;
+    const char* _stateFile;
+    HttpDownloadProgressPtr _progress;
+
+    uint32_t    _hash;
+    uint32_t    _offset;
+    uint32_t    _size;
+    uint32_t    _crc;
+    // The server sent an empty resource, the size 0 is known
+    bool        _empty;
+
+    // The range that is received
+    HttpBodyHandlerPtr _sink;
+    uint32_t    _received;
+    uint32_t    _rangeCrc;
+    char        _rangeHeader[48];
+};
+
+#endif /* _SODAQ_HTTPDOWNLOAD_H */
@@ -0,0 +1,62 @@
+/*
+Copyright (c) 2019, SODAQ
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <string.h>
+
+#include "Sodaq_HttpHeaders.h"
+
+Sodaq_HttpHeaders::Sodaq_HttpHeaders()
+{
+    _used = 0;
+
+    memset(_names, 0, sizeof(_names));
+    memset(_values, 0, sizeof(_values));
+}
+
+bool Sodaq_HttpHeaders::set(uint8_t index, const char* name, const char* value)
+{
+    if (index >= SODAQ_HTTP_HEADER_SLOTS || (name && !value)) {
+        return false;
+    }
+
+    _names[index] = name;
+    _values[index] = value;
+    _used |= (1 << index);
+
+    return true;
+}
+
+void Sodaq_HttpHeaders::release(uint8_t index)
+{
+    if (index < SODAQ_HTTP_HEADER_SLOTS) {
+        _used &= ~(1 << index);
+    }
+}
@@ -0,0 +1,74 @@
+/*
+Copyright (c) 2019, SODAQ
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _SODAQ_HTTPHEADERS_H
+#define _SODAQ_HTTPHEADERS_H
+
+#include <stdint.h>
+
+// The number of custom header slots of an http profile
+#define SODAQ_HTTP_HEADER_SLOTS 5
+
+/**
+ * A set of custom headers for the slots of http profile 0
+ *
+ * The set is applied with Sodaq_R4X::httpApplyHeaders(), or before every
+ * request with Sodaq_R4X::httpSetHeaders(). The modem driver remembers
+ * what each slot holds, so only the changed slots are sent.
+ *
+ * Only the slots that are set or cleared in the set are applied, the
+ * other slots are left alone, e.g. the slot of Sodaq_HttpCache.
+ *
+ * The name and value strings are not copied.
+ */
+class Sodaq_HttpHeaders
+{
+public:
+    Sodaq_HttpHeaders();
+
+    // Index has a range [0-4], see Sodaq_R4X::httpSetCustomHeader()
+    bool set(uint8_t index, const char* name, const char* value);
+    // The slot is cleared when the set is applied
+    bool clear(uint8_t index) { return set(index, 0, 0); }
+    // The slot is no longer applied
+    void release(uint8_t index);
+
+    bool isUsed(uint8_t index) const { return (index < SODAQ_HTTP_HEADER_SLOTS) && (_used & (1 << index)); }
+    const char* getName(uint8_t index) const { return isUsed(index) ? _names[index] : 0; }
+    const char* getValue(uint8_t index) const { return isUsed(index) ? _values[index] : 0; }
+
+private:
+    uint8_t     _used;
+    const char* _names[SODAQ_HTTP_HEADER_SLOTS];
+    const char* _values[SODAQ_HTTP_HEADER_SLOTS];
+};
+
+#endif /* _SODAQ_HTTPHEADERS_H */
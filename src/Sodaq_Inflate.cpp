@@ -0,0 +1,745 @@
+/*
+Copyright (c) 2019, SODAQ
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "Sodaq_Inflate.h"
+#include "Sodaq_Utils.h"
+
+#define ADLER32_MOD 65521UL
+
+#define WINDOW_MASK (SODAQ_INFLATE_WINDOW_SIZE - 1)
+
+#if (SODAQ_INFLATE_WINDOW_SIZE & WINDOW_MASK) != 0
+#error "SODAQ_INFLATE_WINDOW_SIZE must be a power of two"
+#endif
+
+#define GZIP_ID1 0x1F
+#define GZIP_ID2 0x8B
+#define GZIP_HEADER_SIZE 10
+#define GZIP_FLAG_HCRC 0x02
+#define GZIP_FLAG_EXTRA 0x04
+#define GZIP_FLAG_NAME 0x08
+#define GZIP_FLAG_COMMENT 0x10
+#define DEFLATE_METHOD 8
+#define ZLIB_FLAG_DICT 0x20
+
+#define FIXED_LCODES 288
+#define END_OF_BLOCK 256
+#define CODE_LENGTH_CODES 19
+
+#define DECODE_NEED_INPUT -1
+#define DECODE_INVALID -2
+
+// Steps of the gzip header after the fixed part
+enum HeaderSteps {
+    HeaderFixed = 0,
+    HeaderExtraLength,
+    HeaderExtra,
+    HeaderName,
+    HeaderComment,
+    HeaderCrc
+};
+
+static const uint16_t lengthBase[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t lengthExtra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t distBase[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+    8193, 12289, 16385, 24577 };
+static const uint8_t distExtra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+static const uint8_t codeLengthOrder[CODE_LENGTH_CODES] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+static uint32_t adler32_update(uint32_t adler, const uint8_t* data, size_t size)
+{
+    uint32_t a = adler & 0xFFFF;
+    uint32_t b = adler >> 16;
+
+    for (size_t i = 0; i < size; i++) {
+        a = (a + data[i]) % ADLER32_MOD;
+        b = (b + a) % ADLER32_MOD;
+    }
+
+    return (b << 16) | a;
+}
+
+static uint32_t get_be32(const uint8_t* p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+Sodaq_Inflate::Sodaq_Inflate()
+{
+    _sink = 0;
+    _lengthCode.symbol = _lengthSymbols;
+    _distCode.symbol = _distSymbols;
+
+    begin();
+}
+
+void Sodaq_Inflate::begin(InflateFormats format)
+{
+    _format = format;
+    _state = StateHeader;
+
+    _in = 0;
+    _inEnd = 0;
+    _bitBuffer = 0;
+    _bitCount = 0;
+
+    _flags = 0;
+    _step = HeaderFixed;
+    _count = 0;
+
+    _lastBlock = false;
+    _decodeLength = 0;
+    _symbol = -1;
+
+    _windowPos = 0;
+    _flushPos = 0;
+    _total = 0;
+    _crc = CRC32_INIT;
+    _adler = 1;
+}
+
+bool Sodaq_Inflate::write(const uint8_t* data, size_t size)
+{
+    _in = data;
+    _inEnd = data + size;
+
+    bool progress = true;
+
+    while (progress) {
+        switch (_state) {
+        case StateHeader:
+            progress = header();
+            break;
+
+        case StateBlockHeader:
+            progress = needBits(3);
+
+            if (progress) {
+                _lastBlock = getBits(1);
+
+                switch (getBits(2)) {
+                case 0:
+                    // Stored blocks start at a byte boundary
+                    getBits(_bitCount & 7);
+                    _state = StateStoredLength;
+                    break;
+                case 1: {
+                    uint16_t i = 0;
+
+                    for (; i < 144; i++) { _lengths[i] = 8; }
+                    for (; i < 256; i++) { _lengths[i] = 9; }
+                    for (; i < 280; i++) { _lengths[i] = 7; }
+                    for (; i < FIXED_LCODES; i++) { _lengths[i] = 8; }
+                    for (; i < FIXED_LCODES + SODAQ_INFLATE_MAX_DCODES; i++) { _lengths[i] = 5; }
+
+                    construct(_lengthCode, _lengths, FIXED_LCODES);
+                    construct(_distCode, &_lengths[FIXED_LCODES], SODAQ_INFLATE_MAX_DCODES);
+                    _state = StateCodes;
+                    break;
+                }
+                case 2:
+                    _state = StateTableCounts;
+                    break;
+                default:
+                    fail();
+                    break;
+                }
+            }
+            break;
+
+        case StateStoredLength:
+            progress = needBits(32);
+
+            if (progress) {
+                _remaining = getBits(16);
+
+                if ((uint16_t)~getBits(16) != _remaining) {
+                    fail();
+                }
+                else {
+                    _state = StateStored;
+                }
+            }
+            break;
+
+        case StateStored:
+            while (_remaining > 0 && (progress = needBits(8))) {
+                putByte(getBits(8));
+                _remaining--;
+            }
+
+            if (_remaining == 0) {
+                endBlock();
+            }
+            break;
+
+        case StateTableCounts:
+            progress = needBits(14);
+
+            if (progress) {
+                _lengthCount = getBits(5) + 257;
+                _distCount = getBits(5) + 1;
+                _codeCount = getBits(4) + 4;
+
+                if (_lengthCount > 286 || _distCount > SODAQ_INFLATE_MAX_DCODES) {
+                    fail();
+                }
+                else {
+                    _index = 0;
+                    _state = StateCodeLengthCodes;
+                }
+            }
+            break;
+
+        case StateCodeLengthCodes:
+            while (_index < _codeCount && (progress = needBits(3))) {
+                _lengths[codeLengthOrder[_index++]] = getBits(3);
+            }
+
+            if (_index == _codeCount) {
+                for (; _index < CODE_LENGTH_CODES; _index++) {
+                    _lengths[codeLengthOrder[_index]] = 0;
+                }
+
+                // The length code is used for the code length code while reading the lengths
+                if (!construct(_lengthCode, _lengths, CODE_LENGTH_CODES)) {
+                    fail();
+                }
+                else {
+                    _index = 0;
+                    _symbol = -1;
+                    _state = StateCodeLengths;
+                }
+            }
+            break;
+
+        case StateCodeLengths:
+            progress = codeLengths();
+            break;
+
+        case StateCodes:
+            progress = codes();
+            break;
+
+        case StateTrailer:
+            progress = trailer();
+            break;
+
+        default:
+            // Data after the end of the stream is ignored
+            progress = false;
+            break;
+        }
+    }
+
+    flush();
+
+    _in = 0;
+    _inEnd = 0;
+
+    return _state != StateError;
+}
+
+bool Sodaq_Inflate::needBits(uint8_t count)
+{
+    while (_bitCount < count) {
+        if (_in == _inEnd) {
+            return false;
+        }
+
+        _bitBuffer |= (uint32_t)*_in++ << _bitCount;
+        _bitCount += 8;
+    }
+
+    return true;
+}
+
+// Only call after needBits(count), count <= 16
+uint32_t Sodaq_Inflate::getBits(uint8_t count)
+{
+    uint32_t value = _bitBuffer & ((1UL << count) - 1);
+
+    _bitBuffer >>= count;
+    _bitCount -= count;
+
+    return value;
+}
+
+// Decodes one bit at a time, so a code can be continued in the next write()
+int Sodaq_Inflate::decode(const huffman_t& h)
+{
+    if (_decodeLength == 0) {
+        _decodeCode = 0;
+        _decodeFirst = 0;
+        _decodeIndex = 0;
+        _decodeLength = 1;
+    }
+
+    while (_decodeLength <= SODAQ_INFLATE_MAX_BITS) {
+        if (!needBits(1)) {
+            return DECODE_NEED_INPUT;
+        }
+
+        _decodeCode |= getBits(1);
+        uint16_t count = h.count[_decodeLength];
+
+        if (_decodeCode < _decodeFirst + count) {
+            _decodeLength = 0;
+            return h.symbol[_decodeIndex + (_decodeCode - _decodeFirst)];
+        }
+
+        _decodeIndex += count;
+        _decodeFirst = (_decodeFirst + count) << 1;
+        _decodeCode <<= 1;
+        _decodeLength++;
+    }
+
+    _decodeLength = 0;
+    return DECODE_INVALID;
+}
+
+// Builds a canonical Huffman code from the code lengths, false if it is over-subscribed
+bool Sodaq_Inflate::construct(huffman_t& h, const uint8_t* length, uint16_t count)
+{
+    uint16_t offsets[SODAQ_INFLATE_MAX_BITS + 1];
+
+    for (uint8_t len = 0; len <= SODAQ_INFLATE_MAX_BITS; len++) {
+        h.count[len] = 0;
+    }
+
+    for (uint16_t symbol = 0; symbol < count; symbol++) {
+        h.count[length[symbol]]++;
+    }
+
+    int32_t left = 1;
+
+    for (uint8_t len = 1; len <= SODAQ_INFLATE_MAX_BITS; len++) {
+        left = (left << 1) - h.count[len];
+
+        if (left < 0) {
+            return false;
+        }
+    }
+
+    offsets[1] = 0;
+
+    for (uint8_t len = 1; len < SODAQ_INFLATE_MAX_BITS; len++) {
+        offsets[len + 1] = offsets[len] + h.count[len];
+    }
+
+    for (uint16_t symbol = 0; symbol < count; symbol++) {
+        if (length[symbol] != 0) {
+            h.symbol[offsets[length[symbol]]++] = symbol;
+        }
+    }
+
+    return true;
+}
+
+bool Sodaq_Inflate::header()
+{
+    if (_format == InflateAuto) {
+        // Peek at the first two bytes
+        if (!needBits(16)) {
+            return false;
+        }
+
+        uint8_t b0 = _bitBuffer & 0xFF;
+        uint8_t b1 = (_bitBuffer >> 8) & 0xFF;
+
+        if (b0 == GZIP_ID1 && b1 == GZIP_ID2) {
+            _format = InflateGzip;
+        }
+        else if ((b0 & 0x0F) == DEFLATE_METHOD && ((b0 << 8) | b1) % 31 == 0) {
+            _format = InflateZlib;
+        }
+        else {
+            _format = InflateRaw;
+        }
+    }
+
+    if (_format == InflateRaw) {
+        _state = StateBlockHeader;
+        return true;
+    }
+
+    while (_state == StateHeader) {
+        if (!needBits(8)) {
+            return false;
+        }
+
+        if (!headerByte(getBits(8))) {
+            fail();
+        }
+    }
+
+    return true;
+}
+
+bool Sodaq_Inflate::headerByte(uint8_t b)
+{
+    if (_format == InflateZlib) {
+        if (_count++ == 0) {
+            _flags = b;
+            return (b & 0x0F) == DEFLATE_METHOD;
+        }
+
+        if ((((uint16_t)_flags << 8) | b) % 31 != 0 || (b & ZLIB_FLAG_DICT)) {
+            return false;
+        }
+
+        _state = StateBlockHeader;
+        return true;
+    }
+
+    switch (_step) {
+    case HeaderFixed:
+        if ((_count == 0 && b != GZIP_ID1) || (_count == 1 && b != GZIP_ID2)
+                || (_count == 2 && b != DEFLATE_METHOD)) {
+            return false;
+        }
+
+        if (_count == 3) {
+            _flags = b;
+        }
+
+        if (++_count < GZIP_HEADER_SIZE) {
+            return true;
+        }
+
+        _count = 0;
+        break;
+
+    case HeaderExtraLength:
+        _remaining = (_count == 0) ? b : (_remaining | ((uint16_t)b << 8));
+
+        if (++_count < 2) {
+            return true;
+        }
+
+        _count = 0;
+        _flags &= ~GZIP_FLAG_EXTRA;
+
+        if (_remaining > 0) {
+            _step = HeaderExtra;
+            return true;
+        }
+        break;
+
+    case HeaderExtra:
+        if (--_remaining > 0) {
+            return true;
+        }
+        break;
+
+    case HeaderName:
+    case HeaderComment:
+        if (b != 0) {
+            return true;
+        }
+        break;
+
+    case HeaderCrc:
+        if (++_count < 2) {
+            return true;
+        }
+        break;
+    }
+
+    // The optional fields follow in this order
+    if (_flags & GZIP_FLAG_EXTRA) {
+        _step = HeaderExtraLength;
+    }
+    else if (_flags & GZIP_FLAG_NAME) {
+        _flags &= ~GZIP_FLAG_NAME;
+        _step = HeaderName;
+    }
+    else if (_flags & GZIP_FLAG_COMMENT) {
+        _flags &= ~GZIP_FLAG_COMMENT;
+        _step = HeaderComment;
+    }
+    else if (_flags & GZIP_FLAG_HCRC) {
+        _flags &= ~GZIP_FLAG_HCRC;
+        _count = 0;
+        _step = HeaderCrc;
+    }
+    else {
+        _state = StateBlockHeader;
+    }
+
+    return true;
+}
+
+// Reads the literal/length and distance code lengths of a dynamic block
+bool Sodaq_Inflate::codeLengths()
+{
+    uint16_t total = _lengthCount + _distCount;
+
+    while (_index < total) {
+        if (_symbol < 0) {
+            _symbol = decode(_lengthCode);
+
+            if (_symbol == DECODE_NEED_INPUT) {
+                _symbol = -1;
+                return false;
+            }
+
+            if (_symbol < 0) {
+                fail();
+                return false;
+            }
+        }
+
+        if (_symbol < 16) {
+            _lengths[_index++] = _symbol;
+            _symbol = -1;
+            continue;
+        }
+
+        uint8_t length = 0;
+        uint8_t repeat;
+
+        if (_symbol == 16) {
+            // Repeats the previous length
+            if (_index == 0) {
+                fail();
+                return false;
+            }
+
+            if (!needBits(2)) {
+                return false;
+            }
+
+            length = _lengths[_index - 1];
+            repeat = 3 + getBits(2);
+        }
+        else if (_symbol == 17) {
+            if (!needBits(3)) {
+                return false;
+            }
+
+            repeat = 3 + getBits(3);
+        }
+        else {
+            if (!needBits(7)) {
+                return false;
+            }
+
+            repeat = 11 + getBits(7);
+        }
+
+        if (_index + repeat > total) {
+            fail();
+            return false;
+        }
+
+        while (repeat--) {
+            _lengths[_index++] = length;
+        }
+
+        _symbol = -1;
+    }
+
+    // The end of block code is required
+    if (_lengths[END_OF_BLOCK] == 0
+            || !construct(_lengthCode, _lengths, _lengthCount)
+            || !construct(_distCode, &_lengths[_lengthCount], _distCount)) {
+        fail();
+        return false;
+    }
+
+    _state = StateCodes;
+    return true;
+}
+
+// Decodes literals and copies until the end of the block
+bool Sodaq_Inflate::codes()
+{
+    while (true) {
+        if (_symbol < 0) {
+            int symbol = decode(_lengthCode);
+
+            if (symbol == DECODE_NEED_INPUT) {
+                return false;
+            }
+
+            if (symbol < 0 || symbol - 257 >= 29) {
+                fail();
+                return false;
+            }
+
+            if (symbol < END_OF_BLOCK) {
+                putByte(symbol);
+                continue;
+            }
+
+            if (symbol == END_OF_BLOCK) {
+                endBlock();
+                return true;
+            }
+
+            _symbol = symbol - 257;
+            _length = 0;
+        }
+
+        // The length, then the distance symbol is kept in _symbol
+        if (_length == 0) {
+            if (!needBits(lengthExtra[_symbol])) {
+                return false;
+            }
+
+            _length = lengthBase[_symbol] + getBits(lengthExtra[_symbol]);
+            _symbol = SODAQ_INFLATE_MAX_DCODES;
+        }
+
+        if (_symbol == SODAQ_INFLATE_MAX_DCODES) {
+            int symbol = decode(_distCode);
+
+            if (symbol == DECODE_NEED_INPUT) {
+                return false;
+            }
+
+            if (symbol < 0 || symbol >= SODAQ_INFLATE_MAX_DCODES) {
+                fail();
+                return false;
+            }
+
+            _symbol = symbol;
+        }
+
+        if (!needBits(distExtra[_symbol])) {
+            return false;
+        }
+
+        uint32_t distance = distBase[_symbol] + getBits(distExtra[_symbol]);
+
+        if (distance > SODAQ_INFLATE_WINDOW_SIZE || distance > _total) {
+            fail();
+            return false;
+        }
+
+        uint32_t from = (_windowPos - distance) & WINDOW_MASK;
+
+        while (_length--) {
+            putByte(_window[from]);
+            from = (from + 1) & WINDOW_MASK;
+        }
+
+        _length = 0;
+        _symbol = -1;
+    }
+}
+
+void Sodaq_Inflate::endBlock()
+{
+    if (_lastBlock) {
+        _index = 0;
+        _state = StateTrailer;
+    }
+    else {
+        _state = StateBlockHeader;
+    }
+}
+
+// Reads and verifies the checksum and size
+bool Sodaq_Inflate::trailer()
+{
+    uint8_t size = (_format == InflateGzip) ? 8 : (_format == InflateZlib) ? 4 : 0;
+
+    // The trailer starts at a byte boundary
+    getBits(_bitCount & 7);
+
+    while (_index < size) {
+        if (!needBits(8)) {
+            return false;
+        }
+
+        _trailer[_index++] = getBits(8);
+    }
+
+    flush();
+
+    if ((_format == InflateGzip
+                && (get_le32(_trailer) != (_crc ^ CRC32_INIT) || get_le32(&_trailer[4]) != _total))
+            || (_format == InflateZlib && get_be32(_trailer) != _adler)) {
+        fail();
+        return false;
+    }
+
+    _state = StateDone;
+    return false;
+}
+
+void Sodaq_Inflate::putByte(uint8_t b)
+{
+    _window[_windowPos++] = b;
+    _total++;
+
+    if (_windowPos == SODAQ_INFLATE_WINDOW_SIZE) {
+        flush();
+        _windowPos = 0;
+        _flushPos = 0;
+    }
+}
+
+// Passes the output since the previous flush to the sink
+void Sodaq_Inflate::flush()
+{
+    size_t size = _windowPos - _flushPos;
+
+    if (size == 0) {
+        return;
+    }
+
+    const uint8_t* data = &_window[_flushPos];
+
+    if (_format == InflateGzip) {
+        _crc = crc32_update(_crc, data, size);
+    }
+    else if (_format == InflateZlib) {
+        _adler = adler32_update(_adler, data, size);
+    }
+
+    if (_sink) {
+        _sink(data, size, _total - (_windowPos - _flushPos));
+    }
+
+    _flushPos = _windowPos;
+}
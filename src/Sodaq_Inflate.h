@@ -0,0 +1,174 @@
+/*
+Copyright (c) 2019, SODAQ
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _SODAQ_INFLATE_H
+#define _SODAQ_INFLATE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// The size of the history, must be a power of two. A stream that refers
+// further back than this is rejected, e.g. compress with a window of 4 KB
+// (zlib windowBits 12) for the default size.
+#ifndef SODAQ_INFLATE_WINDOW_SIZE
+#define SODAQ_INFLATE_WINDOW_SIZE 4096
+#endif
+
+#define SODAQ_INFLATE_MAX_BITS    15
+#define SODAQ_INFLATE_MAX_LCODES  288
+#define SODAQ_INFLATE_MAX_DCODES  30
+
+enum InflateFormats
+{
+    InflateRaw,
+    InflateZlib,
+    InflateGzip,
+    // gzip or zlib if the stream starts with its header, raw otherwise
+    InflateAuto
+};
+
+// Receives the decompressed data, offset is the position in the output
+typedef void(*InflateSinkPtr)(const uint8_t* data, size_t size, uint32_t offset);
+
+/**
+ * Streaming deflate decoder (RFC 1951) with zlib (RFC 1950) and
+ * gzip (RFC 1952) framing
+ *
+ * The compressed data can be passed in pieces of any size, e.g. as it is
+ * received. The output goes to the sink in pieces of at most
+ * SODAQ_INFLATE_WINDOW_SIZE bytes. The checksum in the zlib or gzip
+ * trailer is verified.
+ *
+ * Only the window is kept in RAM, so the output does not need to fit.
+ */
+class Sodaq_Inflate
+{
+public:
+    Sodaq_Inflate();
+
+    void setSink(InflateSinkPtr sink) { _sink = sink; }
+    // Starts a new stream
+    void begin(InflateFormats format = InflateAuto);
+
+    // Decompresses the data and passes the output to the sink.
+    // Returns false if the data is not valid, or refers beyond the window.
+    bool write(const uint8_t* data, size_t size);
+
+    // True when the end of the stream, including the trailer, is reached
+    bool isDone() const { return _state == StateDone; }
+    bool hasError() const { return _state == StateError; }
+    uint32_t getOutputSize() const { return _total; }
+
+private:
+    enum States {
+        StateHeader = 0,
+        StateBlockHeader,
+        StateStoredLength,
+        StateStored,
+        StateTableCounts,
+        StateCodeLengthCodes,
+        StateCodeLengths,
+        StateCodes,
+        StateTrailer,
+        StateDone,
+        StateError,
+    };
+
+    struct huffman_t {
+        uint16_t  count[SODAQ_INFLATE_MAX_BITS + 1];
+        uint16_t* symbol;
+    };
+
+    bool     needBits(uint8_t count);
+    uint32_t getBits(uint8_t count);
+    int      decode(const huffman_t& h);
+    bool     construct(huffman_t& h, const uint8_t* length, uint16_t count);
+
+    bool     header();
+    bool     headerByte(uint8_t b);
+    bool     codeLengths();
+    bool     codes();
+    void     endBlock();
+    bool     trailer();
+
+    void     putByte(uint8_t b);
+    void     flush();
+    void     fail() { _state = StateError; }
+
+    InflateSinkPtr _sink;
+
+    uint8_t     _format;
+    uint8_t     _state;
+
+    // The input of the current write()
+    const uint8_t* _in;
+    const uint8_t* _inEnd;
+    uint32_t    _bitBuffer;
+    uint8_t     _bitCount;
+
+    // Header and trailer
+    uint8_t     _flags;
+    uint8_t     _step;
+    uint16_t    _count;
+    uint8_t     _trailer[8];
+
+    // Blocks
+    bool        _lastBlock;
+    uint16_t    _remaining;
+    uint16_t    _lengthCount;
+    uint8_t     _distCount;
+    uint8_t     _codeCount;
+    uint16_t    _index;
+    int16_t     _symbol;
+    uint16_t    _length;
+
+    // The state of a partly decoded code
+    uint32_t    _decodeCode;
+    uint32_t    _decodeFirst;
+    uint16_t    _decodeIndex;
+    uint8_t     _decodeLength;
+
+    huffman_t   _lengthCode;
+    huffman_t   _distCode;
+    uint16_t    _lengthSymbols[SODAQ_INFLATE_MAX_LCODES];
+    uint16_t    _distSymbols[SODAQ_INFLATE_MAX_DCODES];
+    uint8_t     _lengths[SODAQ_INFLATE_MAX_LCODES + SODAQ_INFLATE_MAX_DCODES];
+
+    // Output
+    uint8_t     _window[SODAQ_INFLATE_WINDOW_SIZE];
+    uint32_t    _windowPos;
+    uint32_t    _flushPos;
+    uint32_t    _total;
+    uint32_t    _crc;
+    uint32_t    _adler;
+};
+
+#endif /* _SODAQ_INFLATE_H */
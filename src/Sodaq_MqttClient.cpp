@@ -0,0 +1,801 @@
+/*
+Copyright (c) 2019, SODAQ
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "Sodaq_MqttClient.h"
+
+/**
+ * MQTT control packet types (upper nibble of the fixed header)
+ */
+#define MQTT_CONNECT        1
+#define MQTT_CONNACK        2
+#define MQTT_PUBLISH        3
+#define MQTT_PUBACK         4
+#define MQTT_PUBREC         5
+#define MQTT_PUBREL         6
+#define MQTT_PUBCOMP        7
+#define MQTT_SUBSCRIBE      8
+#define MQTT_SUBACK         9
+#define MQTT_UNSUBSCRIBE    10
+#define MQTT_UNSUBACK       11
+#define MQTT_PINGREQ        12
+#define MQTT_PINGRESP       13
+#define MQTT_DISCONNECT     14
+
+#define MQTT_HEADER(type, flags) (((type) << 4) | (flags))
+
+#define MQTT_FLAG_DUP       0x08
+#define MQTT_FLAG_RETAIN    0x01
+
+#define MQTT_CONNECT_USERNAME       0x80
+#define MQTT_CONNECT_PASSWORD       0x40
+#define MQTT_CONNECT_CLEAN_SESSION  0x02
+
+#define MQTT_PROTOCOL_LEVEL 4
+#define MQTT_SUBACK_FAILURE 0x80
+
+static inline bool is_timedout(uint32_t from, uint32_t nr_ms) __attribute__((always_inline));
+static inline bool is_timedout(uint32_t from, uint32_t nr_ms) { return (millis() - from) > nr_ms; }
+
+static inline uint8_t* put_be16(uint8_t* p, uint16_t v) { p[0] = v >> 8; p[1] = v & 0xFF; return p + 2; }
+static inline uint16_t get_be16(const uint8_t* p) { return (p[0] << 8) | p[1]; }
+
+static uint8_t* put_string(uint8_t* p, const char* s)
+{
+    size_t length = strlen(s);
+
+    p = put_be16(p, length);
+    memcpy(p, s, length);
+
+    return p + length;
+}
+
+/**
+ * Returns the size of the fixed header of a packet, or 0 if
+ * it is not complete yet
+ */
+static size_t get_header_size(const uint8_t* packet, size_t size, size_t* remainingLength)
+{
+    size_t value = 0;
+
+    for (size_t i = 1; i < size && i <= 4; i++) {
+        value |= (size_t)(packet[i] & 0x7F) << (7 * (i - 1));
+
+        if ((packet[i] & 0x80) == 0) {
+            *remainingLength = value;
+            return i + 1;
+        }
+    }
+
+    return 0;
+}
+
+Sodaq_MqttClient::Sodaq_MqttClient(Sodaq_R4X& modem) : _modem(modem)
+{
+    _host = 0;
+    _port = SODAQ_MQTT_CLIENT_DEFAULT_PORT;
+    _socket = -1;
+
+    _clientId[0] = 0;
+    _username = 0;
+    _password = 0;
+    _keepAlive = SODAQ_MQTT_CLIENT_DEFAULT_KEEPALIVE;
+    _cleanSession = true;
+    _timeout = SODAQ_MQTT_CLIENT_DEFAULT_TIMEOUT;
+
+    _connected = false;
+    _sessionPresent = false;
+    _lastSend = 0;
+    _pingSent = 0;
+    _pingOutstanding = false;
+    _packetId = 0;
+    _messageCount = 0;
+
+    _handler = 0;
+
+    _ackType = 0;
+    _ackPacketId = 0;
+    _ackReceived = false;
+    _ackReturnCode = 0;
+
+    memset(_inflight, 0, sizeof(_inflight));
+    memset(_qos2Received, 0, sizeof(_qos2Received));
+
+    _rxLength = 0;
+    _rxSkip = 0;
+}
+
+void Sodaq_MqttClient::setClientId(const char* id)
+{
+    strncpy(_clientId, id, sizeof(_clientId) - 1);
+    _clientId[sizeof(_clientId) - 1] = 0;
+}
+
+bool Sodaq_MqttClient::connect()
+{
+    closeSocket();
+
+    if (_host == 0) {
+        return false;
+    }
+
+    _socket = _modem.socketCreate(0, UbloxTCP);
+    if (_socket < 0) {
+        return false;
+    }
+
+    if (!_modem.socketConnect(_socket, _host, _port)) {
+        closeSocket();
+        return false;
+    }
+
+    size_t remainingLength = 10 + 2 + strlen(_clientId);
+    uint8_t flags = _cleanSession ? MQTT_CONNECT_CLEAN_SESSION : 0;
+
+    if (_username) {
+        remainingLength += 2 + strlen(_username);
+        flags |= MQTT_CONNECT_USERNAME;
+
+        if (_password) {
+            remainingLength += 2 + strlen(_password);
+            flags |= MQTT_CONNECT_PASSWORD;
+        }
+    }
+
+    if (remainingLength + 5 > sizeof(_txBuffer)) {
+        closeSocket();
+        return false;
+    }
+
+    uint8_t* p = _txBuffer + startPacket(_txBuffer, MQTT_HEADER(MQTT_CONNECT, 0), remainingLength);
+    p = put_string(p, "MQTT");
+    *p++ = MQTT_PROTOCOL_LEVEL;
+    *p++ = flags;
+    p = put_be16(p, _keepAlive);
+    p = put_string(p, _clientId);
+
+    if (flags & MQTT_CONNECT_USERNAME) {
+        p = put_string(p, _username);
+    }
+
+    if (flags & MQTT_CONNECT_PASSWORD) {
+        p = put_string(p, _password);
+    }
+
+    if (!request(_txBuffer, p - _txBuffer, MQTT_CONNACK, 0) || _ackReturnCode != 0) {
+        closeSocket();
+        return false;
+    }
+
+    _connected = true;
+
+    if (_cleanSession || !_sessionPresent) {
+        // The server has no state, drop ours as well
+        memset(_inflight, 0, sizeof(_inflight));
+        memset(_qos2Received, 0, sizeof(_qos2Received));
+    }
+    else {
+        resendInflight();
+    }
+
+    return true;
+}
+
+bool Sodaq_MqttClient::disconnect()
+{
+    bool retval = true;
+
+    if (isConnected()) {
+        uint8_t packet[] = { MQTT_HEADER(MQTT_DISCONNECT, 0), 0 };
+        retval = writePacket(packet, sizeof(packet));
+    }
+
+    closeSocket();
+
+    return retval;
+}
+
+bool Sodaq_MqttClient::isConnected()
+{
+    if (_connected && _modem.socketIsClosed(_socket)) {
+        _connected = false;
+    }
+
+    return _connected;
+}
+
+bool Sodaq_MqttClient::publish(const char* topic, const uint8_t* msg, size_t size, uint8_t qos, bool retain)
+{
+    if (qos > 2 || !isConnected()) {
+        return false;
+    }
+
+    size_t topicLength = strlen(topic);
+    size_t remainingLength = 2 + topicLength + (qos > 0 ? 2 : 0) + size;
+
+    if (remainingLength + 5 > SODAQ_MQTT_CLIENT_MAX_PACKET_SIZE) {
+        return false;
+    }
+
+    inflight_t* slot = 0;
+    uint8_t* buffer = _txBuffer;
+
+    if (qos > 0) {
+        slot = allocInflight(_timeout);
+        if (!slot) {
+            return false;
+        }
+        buffer = slot->packet;
+    }
+
+    uint8_t* p = buffer + startPacket(buffer, MQTT_HEADER(MQTT_PUBLISH, (qos << 1) | (retain ? MQTT_FLAG_RETAIN : 0)),
+                                      remainingLength);
+    p = put_be16(p, topicLength);
+    memcpy(p, topic, topicLength);
+    p += topicLength;
+
+    uint16_t packetId = 0;
+    if (qos > 0) {
+        packetId = nextPacketId();
+        p = put_be16(p, packetId);
+    }
+
+    memcpy(p, msg, size);
+    p += size;
+
+    if (slot) {
+        slot->state = (qos == 1) ? InflightWaitPuback : InflightWaitPubrec;
+        slot->packetId = packetId;
+        slot->size = p - buffer;
+    }
+
+    if (!writePacket(buffer, p - buffer)) {
+        if (slot) {
+            slot->state = InflightFree;
+        }
+        return false;
+    }
+
+    return true;
+}
+
+bool Sodaq_MqttClient::flush(uint32_t timeout)
+{
+    uint32_t start = millis();
+
+    while (getInflightCount() > 0) {
+        uint32_t elapsed = millis() - start;
+        if (elapsed > timeout || !process(timeout - elapsed)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+uint8_t Sodaq_MqttClient::getInflightCount() const
+{
+    uint8_t count = 0;
+
+    for (uint8_t i = 0; i < SODAQ_MQTT_CLIENT_MAX_INFLIGHT; i++) {
+        if (_inflight[i].state != InflightFree) {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+bool Sodaq_MqttClient::subscribe(const char* filter, uint8_t qos)
+{
+    size_t remainingLength = 2 + 2 + strlen(filter) + 1;
+
+    if (!isConnected() || remainingLength + 5 > sizeof(_txBuffer)) {
+        return false;
+    }
+
+    uint16_t packetId = nextPacketId();
+
+    uint8_t* p = _txBuffer + startPacket(_txBuffer, MQTT_HEADER(MQTT_SUBSCRIBE, 2), remainingLength);
+    p = put_be16(p, packetId);
+    p = put_string(p, filter);
+    *p++ = min(qos, (uint8_t)2);
+
+    return request(_txBuffer, p - _txBuffer, MQTT_SUBACK, packetId) && (_ackReturnCode != MQTT_SUBACK_FAILURE);
+}
+
+bool Sodaq_MqttClient::unsubscribe(const char* filter)
+{
+    size_t remainingLength = 2 + 2 + strlen(filter);
+
+    if (!isConnected() || remainingLength + 5 > sizeof(_txBuffer)) {
+        return false;
+    }
+
+    uint16_t packetId = nextPacketId();
+
+    uint8_t* p = _txBuffer + startPacket(_txBuffer, MQTT_HEADER(MQTT_UNSUBSCRIBE, 2), remainingLength);
+    p = put_be16(p, packetId);
+    p = put_string(p, filter);
+
+    return request(_txBuffer, p - _txBuffer, MQTT_UNSUBACK, packetId);
+}
+
+bool Sodaq_MqttClient::ping()
+{
+    if (!isConnected()) {
+        return false;
+    }
+
+    uint8_t packet[] = { MQTT_HEADER(MQTT_PINGREQ, 0), 0 };
+
+    return request(packet, sizeof(packet), MQTT_PINGRESP, 0);
+}
+
+size_t Sodaq_MqttClient::loop()
+{
+    if (!isConnected()) {
+        return 0;
+    }
+
+    size_t count = _messageCount;
+
+    while (_modem.socketHasPendingBytes(_socket) && receive()) {
+        // Handle all buffered packets
+    }
+
+    if (_pingOutstanding) {
+        if (is_timedout(_pingSent, _timeout)) {
+            // No PINGRESP, the connection is lost
+            closeSocket();
+        }
+    }
+    else if (_keepAlive > 0 && is_timedout(_lastSend, _keepAlive * 750UL)) {
+        uint8_t packet[] = { MQTT_HEADER(MQTT_PINGREQ, 0), 0 };
+
+        if (writePacket(packet, sizeof(packet))) {
+            _pingOutstanding = true;
+            _pingSent = millis();
+        }
+    }
+
+    return _messageCount - count;
+}
+
+/******************************************************************************
+* Private
+*****************************************************************************/
+
+/**
+ * Write the fixed header
+ *
+ * Returns the size of the header.
+ */
+size_t Sodaq_MqttClient::startPacket(uint8_t* buffer, uint8_t header, size_t remainingLength)
+{
+    size_t i = 0;
+
+    buffer[i++] = header;
+
+    do {
+        uint8_t b = remainingLength & 0x7F;
+        remainingLength >>= 7;
+        buffer[i++] = b | (remainingLength > 0 ? 0x80 : 0);
+    } while (remainingLength > 0);
+
+    return i;
+}
+
+bool Sodaq_MqttClient::writePacket(const uint8_t* packet, size_t size)
+{
+    while (size > 0) {
+        size_t chunkSize = min(size, (size_t)SODAQ_MAX_SEND_MESSAGE_SIZE);
+
+        if (_modem.socketWrite(_socket, packet, chunkSize) != chunkSize) {
+            return false;
+        }
+
+        packet += chunkSize;
+        size -= chunkSize;
+    }
+
+    _lastSend = millis();
+
+    return true;
+}
+
+bool Sodaq_MqttClient::writeAck(uint8_t header, uint16_t packetId)
+{
+    uint8_t packet[] = { header, 2, (uint8_t)(packetId >> 8), (uint8_t)(packetId & 0xFF) };
+
+    return writePacket(packet, sizeof(packet));
+}
+
+/**
+ * Write the packet and wait for the acknowledgement
+ *
+ * Other packets that come in meanwhile are handled as well.
+ */
+bool Sodaq_MqttClient::request(const uint8_t* packet, size_t size, uint8_t ackType, uint16_t packetId)
+{
+    _ackType = ackType;
+    _ackPacketId = packetId;
+    _ackReceived = false;
+    _ackReturnCode = 0;
+
+    if (!writePacket(packet, size)) {
+        _ackType = 0;
+        return false;
+    }
+
+    uint32_t start = millis();
+
+    while (!_ackReceived) {
+        uint32_t elapsed = millis() - start;
+        if (elapsed > _timeout || !process(_timeout - elapsed)) {
+            break;
+        }
+    }
+
+    _ackType = 0;
+
+    return _ackReceived;
+}
+
+/**
+ * Wait for received data and handle it
+ *
+ * Returns false if the socket was closed.
+ */
+bool Sodaq_MqttClient::process(uint32_t timeout)
+{
+    if (_socket < 0) {
+        return false;
+    }
+
+    if (_modem.socketWaitForRead(_socket, timeout)) {
+        receive();
+    }
+
+    if (_modem.socketIsClosed(_socket)) {
+        _connected = false;
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Read the pending bytes of the socket and handle the complete packets
+ */
+bool Sodaq_MqttClient::receive()
+{
+    size_t count = _modem.socketRead(_socket, &_rxBuffer[_rxLength], sizeof(_rxBuffer) - _rxLength);
+    if (count == 0) {
+        return false;
+    }
+
+    _rxLength += count;
+
+    size_t offset = 0;
+
+    if (_rxSkip > 0) {
+        offset = min(_rxSkip, _rxLength);
+        _rxSkip -= offset;
+    }
+
+    while (offset < _rxLength) {
+        size_t remainingLength;
+        size_t headerSize = get_header_size(&_rxBuffer[offset], _rxLength - offset, &remainingLength);
+        if (headerSize == 0) {
+            break;
+        }
+
+        size_t packetSize = headerSize + remainingLength;
+
+        if (packetSize > sizeof(_rxBuffer)) {
+            if (offset > 0 || _rxLength < sizeof(_rxBuffer)) {
+                // Wait for the start of the packet to fill the buffer
+                break;
+            }
+
+            // Too large, only its acknowledgement is handled
+            if ((_rxBuffer[0] >> 4) == MQTT_PUBLISH) {
+                handlePublish(_rxBuffer[0], &_rxBuffer[headerSize], _rxLength - headerSize, false);
+            }
+            _rxSkip = packetSize - _rxLength;
+            offset = _rxLength;
+            break;
+        }
+
+        if (packetSize > _rxLength - offset) {
+            break;
+        }
+
+        handlePacket(&_rxBuffer[offset], packetSize);
+        offset += packetSize;
+    }
+
+    memmove(_rxBuffer, &_rxBuffer[offset], _rxLength - offset);
+    _rxLength -= offset;
+
+    return true;
+}
+
+void Sodaq_MqttClient::handlePacket(uint8_t* packet, size_t size)
+{
+    size_t remainingLength;
+    size_t headerSize = get_header_size(packet, size, &remainingLength);
+    uint8_t type = packet[0] >> 4;
+    uint8_t* body = &packet[headerSize];
+
+    switch (type) {
+    case MQTT_CONNACK:
+        if (remainingLength >= 2) {
+            _sessionPresent = body[0] & 0x01;
+            _ackReturnCode = body[1];
+            handleAck(type, 0);
+        }
+        break;
+
+    case MQTT_PUBLISH:
+        handlePublish(packet[0], body, remainingLength, true);
+        break;
+
+    case MQTT_PUBACK:
+    case MQTT_PUBREC:
+    case MQTT_PUBREL:
+    case MQTT_PUBCOMP:
+    case MQTT_UNSUBACK:
+        if (remainingLength >= 2) {
+            handleAck(type, get_be16(body));
+        }
+        break;
+
+    case MQTT_SUBACK:
+        if (remainingLength >= 3) {
+            _ackReturnCode = body[2];
+            handleAck(type, get_be16(body));
+        }
+        break;
+
+    case MQTT_PINGRESP:
+        _pingOutstanding = false;
+        handleAck(type, 0);
+        break;
+
+    default:
+        break;
+    }
+}
+
+/**
+ * Handle a PUBLISH from the server
+ *
+ * An incomplete (too large) message is only acknowledged.
+ * A QoS 2 message is delivered when it is received for the first time.
+ */
+void Sodaq_MqttClient::handlePublish(uint8_t header, uint8_t* body, size_t size, bool complete)
+{
+    uint8_t qos = (header >> 1) & 0x03;
+
+    if (size < 2) {
+        return;
+    }
+
+    size_t topicLength = get_be16(body);
+    size_t offset = 2 + topicLength + (qos > 0 ? 2 : 0);
+    if (offset > size) {
+        return;
+    }
+
+    uint16_t packetId = (qos > 0) ? get_be16(&body[2 + topicLength]) : 0;
+    bool deliver = complete;
+
+    if (qos == 2) {
+        deliver &= addQos2Received(packetId);
+    }
+
+    if (deliver) {
+        // Move the topic over its length to terminate it
+        memmove(body, &body[2], topicLength);
+        body[topicLength] = 0;
+
+        _messageCount++;
+
+        if (_handler) {
+            mqtt_message_t msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.topic = reinterpret_cast<const char*>(body);
+            msg.payload = &body[offset];
+            msg.size = size - offset;
+            msg.length = msg.size;
+            msg.qos = qos;
+            msg.last = true;
+
+            _handler(&msg);
+        }
+    }
+
+    if (qos == 1) {
+        writeAck(MQTT_HEADER(MQTT_PUBACK, 0), packetId);
+    }
+    else if (qos == 2) {
+        writeAck(MQTT_HEADER(MQTT_PUBREC, 0), packetId);
+    }
+}
+
+void Sodaq_MqttClient::handleAck(uint8_t type, uint16_t packetId)
+{
+    inflight_t* slot = (type == MQTT_PUBACK || type == MQTT_PUBREC || type == MQTT_PUBCOMP) ?
+                       findInflight(packetId) : 0;
+
+    switch (type) {
+    case MQTT_PUBACK:
+        if (slot && slot->state == InflightWaitPuback) {
+            slot->state = InflightFree;
+        }
+        break;
+
+    case MQTT_PUBREC:
+        if (slot && slot->state == InflightWaitPubrec) {
+            slot->state = InflightWaitPubcomp;
+        }
+        writeAck(MQTT_HEADER(MQTT_PUBREL, 2), packetId);
+        break;
+
+    case MQTT_PUBREL:
+        removeQos2Received(packetId);
+        writeAck(MQTT_HEADER(MQTT_PUBCOMP, 0), packetId);
+        break;
+
+    case MQTT_PUBCOMP:
+        if (slot && slot->state == InflightWaitPubcomp) {
+            slot->state = InflightFree;
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    if (type == _ackType && packetId == _ackPacketId) {
+        _ackReceived = true;
+    }
+}
+
+/**
+ * Send the unacknowledged packets again after reconnecting
+ */
+void Sodaq_MqttClient::resendInflight()
+{
+    for (uint8_t i = 0; i < SODAQ_MQTT_CLIENT_MAX_INFLIGHT; i++) {
+        inflight_t* slot = &_inflight[i];
+
+        if (slot->state == InflightWaitPuback || slot->state == InflightWaitPubrec) {
+            slot->packet[0] |= MQTT_FLAG_DUP;
+            writePacket(slot->packet, slot->size);
+        }
+        else if (slot->state == InflightWaitPubcomp) {
+            writeAck(MQTT_HEADER(MQTT_PUBREL, 2), slot->packetId);
+        }
+    }
+}
+
+void Sodaq_MqttClient::closeSocket()
+{
+    if (_socket >= 0) {
+        _modem.socketClose(_socket);
+        _socket = -1;
+    }
+
+    _connected = false;
+    _pingOutstanding = false;
+    _rxLength = 0;
+    _rxSkip = 0;
+}
+
+uint16_t Sodaq_MqttClient::nextPacketId()
+{
+    do {
+        if (++_packetId == 0) {
+            _packetId = 1;
+        }
+    } while (findInflight(_packetId));
+
+    return _packetId;
+}
+
+Sodaq_MqttClient::inflight_t* Sodaq_MqttClient::findInflight(uint16_t packetId)
+{
+    for (uint8_t i = 0; i < SODAQ_MQTT_CLIENT_MAX_INFLIGHT; i++) {
+        if (_inflight[i].state != InflightFree && _inflight[i].packetId == packetId) {
+            return &_inflight[i];
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Returns a free in-flight slot, waits for an acknowledgement if
+ * the window is full
+ */
+Sodaq_MqttClient::inflight_t* Sodaq_MqttClient::allocInflight(uint32_t timeout)
+{
+    uint32_t start = millis();
+
+    while (true) {
+        for (uint8_t i = 0; i < SODAQ_MQTT_CLIENT_MAX_INFLIGHT; i++) {
+            if (_inflight[i].state == InflightFree) {
+                return &_inflight[i];
+            }
+        }
+
+        uint32_t elapsed = millis() - start;
+        if (elapsed > timeout || !process(timeout - elapsed)) {
+            return 0;
+        }
+    }
+}
+
+/**
+ * Remember the packet ID of a received QoS 2 message
+ *
+ * Returns false if it was received before.
+ */
+bool Sodaq_MqttClient::addQos2Received(uint16_t packetId)
+{
+    uint8_t free = SODAQ_MQTT_CLIENT_MAX_QOS2_RECEIVED;
+
+    for (uint8_t i = 0; i < SODAQ_MQTT_CLIENT_MAX_QOS2_RECEIVED; i++) {
+        if (_qos2Received[i] == packetId) {
+            return false;
+        }
+        if (_qos2Received[i] == 0 && free == SODAQ_MQTT_CLIENT_MAX_QOS2_RECEIVED) {
+            free = i;
+        }
+    }
+
+    if (free < SODAQ_MQTT_CLIENT_MAX_QOS2_RECEIVED) {
+        _qos2Received[free] = packetId;
+    }
+
+    return true;
+}
+
+void Sodaq_MqttClient::removeQos2Received(uint16_t packetId)
+{
+    for (uint8_t i = 0; i < SODAQ_MQTT_CLIENT_MAX_QOS2_RECEIVED; i++) {
+        if (_qos2Received[i] == packetId) {
+            _qos2Received[i] = 0;
+        }
+    }
+}
@@ -0,0 +1,181 @@
+/*
+Copyright (c) 2019, SODAQ
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _SODAQ_MQTTCLIENT_H
+#define _SODAQ_MQTTCLIENT_H
+
+#include <stdint.h>
+
+#include "Sodaq_R4X.h"
+
+#ifndef SODAQ_MQTT_CLIENT_MAX_PACKET_SIZE
+#define SODAQ_MQTT_CLIENT_MAX_PACKET_SIZE   256
+#endif
+
+#ifndef SODAQ_MQTT_CLIENT_MAX_INFLIGHT
+#define SODAQ_MQTT_CLIENT_MAX_INFLIGHT      4
+#endif
+
+#define SODAQ_MQTT_CLIENT_MAX_QOS2_RECEIVED 4
+#define SODAQ_MQTT_CLIENT_MAX_CLIENT_ID     23
+
+#define SODAQ_MQTT_CLIENT_DEFAULT_PORT      1883
+#define SODAQ_MQTT_CLIENT_DEFAULT_KEEPALIVE 600
+#define SODAQ_MQTT_CLIENT_DEFAULT_TIMEOUT   (30L * 1000)
+
+/**
+ * MQTT 3.1.1 client over a TCP socket of the modem
+ *
+ * Unlike the MQTT client of the modem (AT+UMQTTC), payloads are binary,
+ * the packet identifiers are visible and several sessions can be used.
+ *
+ * QoS 1 and 2 publishes are pipelined: publish() returns when the packet
+ * is written, and the acknowledgement is handled later by loop().
+ * Up to SODAQ_MQTT_CLIENT_MAX_INFLIGHT publishes can be in flight, after
+ * that publish() waits for a free slot. flush() waits until all in-flight
+ * publishes are acknowledged.
+ *
+ * The in-flight publishes are kept for a persistent session (clean
+ * session off) and are sent again after reconnecting.
+ *
+ * A packet (header, topic and payload) must fit in
+ * SODAQ_MQTT_CLIENT_MAX_PACKET_SIZE bytes. Larger received messages are
+ * acknowledged and dropped.
+ */
+class Sodaq_MqttClient
+{
+public:
+    Sodaq_MqttClient(Sodaq_R4X& modem);
+
+    void setServer(const char* host, uint16_t port = SODAQ_MQTT_CLIENT_DEFAULT_PORT) { _host = host; _port = port; }
+    void setClientId(const char* id);
+    void setAuth(const char* name, const char* pw) { _username = name; _password = pw; }
+    void setKeepAlive(uint16_t seconds) { _keepAlive = seconds; }
+    void setCleanSession(bool cleanSession) { _cleanSession = cleanSession; }
+    void setTimeout(uint32_t timeout) { _timeout = timeout; }
+    void setMessageHandler(MessageHandlerPtr handler) { _handler = handler; }
+
+    bool connect();
+    bool disconnect();
+    bool isConnected();
+    // True if the server still had the session at the last connect()
+    bool isSessionPresent() const { return _sessionPresent; }
+
+    // QoS is 0, 1 or 2. Does not wait for the acknowledgement.
+    bool publish(const char* topic, const uint8_t* msg, size_t size, uint8_t qos = 0, bool retain = false);
+    // Waits until all in-flight publishes are acknowledged.
+    bool flush(uint32_t timeout);
+    uint8_t getInflightCount() const;
+
+    bool subscribe(const char* filter, uint8_t qos = 0);
+    bool unsubscribe(const char* filter);
+    bool ping();
+
+    // Handles the received packets and sends a ping when the keepalive
+    // period is almost over. Does not wait for the server.
+    // Returns the number of received messages.
+    size_t loop();
+
+private:
+    enum InflightStates {
+        InflightFree = 0,
+        InflightWaitPuback,
+        InflightWaitPubrec,
+        InflightWaitPubcomp,
+    };
+
+    struct inflight_t {
+        uint8_t  state;
+        uint16_t packetId;
+        uint16_t size;
+        uint8_t  packet[SODAQ_MQTT_CLIENT_MAX_PACKET_SIZE];
+    };
+
+    size_t   startPacket(uint8_t* buffer, uint8_t header, size_t remainingLength);
+    bool     writePacket(const uint8_t* packet, size_t size);
+    bool     writeAck(uint8_t header, uint16_t packetId);
+    bool     request(const uint8_t* packet, size_t size, uint8_t ackType, uint16_t packetId);
+    bool     process(uint32_t timeout);
+    bool     receive();
+    void     handlePacket(uint8_t* packet, size_t size);
+    void     handlePublish(uint8_t header, uint8_t* body, size_t size, bool complete);
+    void     handleAck(uint8_t type, uint16_t packetId);
+    void     resendInflight();
+    void     closeSocket();
+
+    uint16_t    nextPacketId();
+    inflight_t* findInflight(uint16_t packetId);
+    inflight_t* allocInflight(uint32_t timeout);
+    bool        addQos2Received(uint16_t packetId);
+    void        removeQos2Received(uint16_t packetId);
+
+    Sodaq_R4X&  _modem;
+
+    const char* _host;
+    uint16_t    _port;
+    int         _socket;
+
+    char        _clientId[SODAQ_MQTT_CLIENT_MAX_CLIENT_ID + 1];
+    const char* _username;
+    const char* _password;
+    uint16_t    _keepAlive;
+    bool        _cleanSession;
+    uint32_t    _timeout;
+
+    bool        _connected;
+    bool        _sessionPresent;
+    uint32_t    _lastSend;
+    uint32_t    _pingSent;
+    bool        _pingOutstanding;
+    uint16_t    _packetId;
+    size_t      _messageCount;
+
+    MessageHandlerPtr _handler;
+
+    // The acknowledgement that is waited for
+    uint8_t     _ackType;
+    uint16_t    _ackPacketId;
+    bool        _ackReceived;
+    uint8_t     _ackReturnCode;
+
+    inflight_t  _inflight[SODAQ_MQTT_CLIENT_MAX_INFLIGHT];
+    uint16_t    _qos2Received[SODAQ_MQTT_CLIENT_MAX_QOS2_RECEIVED];
+
+    // Received bytes that do not form a complete packet yet
+    uint8_t     _rxBuffer[SODAQ_MQTT_CLIENT_MAX_PACKET_SIZE];
+    size_t      _rxLength;
+    // Bytes of an oversized packet that still have to be dropped
+    size_t      _rxSkip;
+
+    uint8_t     _txBuffer[SODAQ_MQTT_CLIENT_MAX_PACKET_SIZE];
+};
+
+#endif /* _SODAQ_MQTTCLIENT_H */
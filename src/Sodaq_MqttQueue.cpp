@@ -0,0 +1,164 @@
+/*
+Copyright (c) 2019, SODAQ
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "Sodaq_MqttQueue.h"
+#include "Sodaq_Utils.h"
+#include <Sodaq_wdt.h>
+
+/**
+ * A queued message is
+ *     uint8_t  flags: qos (bit 0..1), retain (bit 2)
+ *     uint8_t  topic size, including the terminating NUL
+ *     uint16_t payload size (little endian)
+ *     topic, payload
+ */
+#define RECORD_HEADER_SIZE  4
+
+static inline bool is_timedout(uint32_t from, uint32_t nr_ms) __attribute__((always_inline));
+static inline bool is_timedout(uint32_t from, uint32_t nr_ms) { return (millis() - from) > nr_ms; }
+
+static inline size_t record_size(const uint8_t* record)
+{
+    return RECORD_HEADER_SIZE + record[1] + get_le16(&record[2]);
+}
+
+Sodaq_MqttQueue::Sodaq_MqttQueue(Sodaq_R4X& r4x) : _r4x(r4x)
+{
+    _size = 0;
+    _count = 0;
+
+    _flushInterval = SODAQ_MQTT_QUEUE_DEFAULT_FLUSH_INTERVAL;
+    _watermark = SODAQ_MQTT_QUEUE_SIZE * 3 / 4;
+    _lastFlush = millis();
+
+    _publishedCount = 0;
+    _failedCount = 0;
+    _dropCount = 0;
+    _drainRate = 0;
+}
+
+bool Sodaq_MqttQueue::publish(const char* topic, const uint8_t* msg, size_t size, uint8_t qos, uint8_t retain)
+{
+    size_t topicSize = strlen(topic) + 1;
+    size_t recordSize = RECORD_HEADER_SIZE + topicSize + size;
+
+    if (topicSize > 0xFF || recordSize > sizeof(_buffer)) {
+        _dropCount++;
+        return false;
+    }
+
+    while (_size + recordSize > sizeof(_buffer)) {
+        dropHead();
+        _dropCount++;
+    }
+
+    uint8_t* record = &_buffer[_size];
+    record[0] = (qos & 0x03) | (retain ? 0x04 : 0);
+    record[1] = topicSize;
+    put_le16(&record[2], size);
+    memcpy(&record[RECORD_HEADER_SIZE], topic, topicSize);
+    memcpy(&record[RECORD_HEADER_SIZE + topicSize], msg, size);
+
+    _size += recordSize;
+    _count++;
+
+    return true;
+}
+
+uint16_t Sodaq_MqttQueue::flush(uint16_t maxMessages)
+{
+    _lastFlush = millis();
+
+    uint32_t start = millis();
+    uint16_t count = 0;
+    size_t offset = 0;
+
+    while (offset < _size && (maxMessages == 0 || count < maxMessages)) {
+        if (_r4x.mqttGetLoginResult() != 0) {
+            break;
+        }
+
+        sodaq_wdt_reset();
+
+        const uint8_t* record = &_buffer[offset];
+        const char* topic = reinterpret_cast<const char*>(&record[RECORD_HEADER_SIZE]);
+        const uint8_t* msg = &record[RECORD_HEADER_SIZE + record[1]];
+
+        if (!_r4x.mqttPublish(topic, msg, get_le16(&record[2]), record[0] & 0x03, (record[0] & 0x04) ? 1 : 0)) {
+            _failedCount++;
+            break;
+        }
+
+        offset += record_size(record);
+        count++;
+    }
+
+    // Remove the published messages
+    memmove(_buffer, &_buffer[offset], _size - offset);
+    _size -= offset;
+    _count -= count;
+    _publishedCount += count;
+
+    if (count > 0) {
+        uint32_t duration = millis() - start;
+        _drainRate = (count * 60000UL) / (duration > 0 ? duration : 1);
+    }
+
+    return count;
+}
+
+uint16_t Sodaq_MqttQueue::loop()
+{
+    if (isEmpty() || _r4x.mqttGetLoginResult() != 0) {
+        return 0;
+    }
+
+    if ((_watermark > 0 && _size >= _watermark) || is_timedout(_lastFlush, _flushInterval)) {
+        return flush();
+    }
+
+    return 0;
+}
+
+void Sodaq_MqttQueue::clear()
+{
+    _size = 0;
+    _count = 0;
+}
+
+void Sodaq_MqttQueue::dropHead()
+{
+    size_t size = record_size(_buffer);
+
+    memmove(_buffer, &_buffer[size], _size - size);
+    _size -= size;
+    _count--;
+}
@@ -0,0 +1,113 @@
+/*
+Copyright (c) 2019, SODAQ
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _SODAQ_MQTTQUEUE_H
+#define _SODAQ_MQTTQUEUE_H
+
+#include <stdint.h>
+
+#include "Sodaq_R4X.h"
+
+#ifndef SODAQ_MQTT_QUEUE_SIZE
+#define SODAQ_MQTT_QUEUE_SIZE           1024
+#endif
+
+#define SODAQ_MQTT_QUEUE_DEFAULT_FLUSH_INTERVAL (60L * 1000)
+
+/**
+ * Outbound MQTT publish queue in RAM
+ *
+ * publish() only queues the message. The queue is drained in bursts by
+ * flush(), or by loop() when the flush interval has passed or the queue
+ * is full beyond the watermark.
+ *
+ * Set the flush interval a bit shorter than the MQTT inactivity timeout
+ * (see mqttSetInactivityTimeout). The burst of publishes then also
+ * keeps the connection alive, and the radio wakes up once per batch
+ * instead of for every message plus the keepalive pings.
+ *
+ * The modem handles the QoS 1/2 handshakes itself. A message counts
+ * as published when the modem accepts it (+UMQTTC: 2,1). A message that
+ * is not accepted stays at the head of the queue.
+ *
+ * When the queue is full, the oldest messages are dropped to make room.
+ */
+class Sodaq_MqttQueue
+{
+public:
+    Sodaq_MqttQueue(Sodaq_R4X& r4x);
+
+    // Queues the message. Returns false if it can never fit in the queue.
+    bool publish(const char* topic, const uint8_t* msg, size_t size, uint8_t qos = 0, uint8_t retain = 0);
+
+    // Publishes the queued messages in order, while logged in. Stops at the
+    // first failure. Returns the number of published messages.
+    uint16_t flush(uint16_t maxMessages = 0);
+
+    // Flushes the queue when it is due. Returns the number of published messages.
+    uint16_t loop();
+
+    void setFlushInterval(uint32_t interval) { _flushInterval = interval; }
+    // Flush as soon as this many bytes are queued, 0 to only flush on the interval
+    void setWatermark(size_t watermark) { _watermark = watermark; }
+
+    void clear();
+    bool isEmpty() const { return _count == 0; }
+
+    // Statistics
+    uint16_t getDepth() const { return _count; }
+    size_t   getQueuedBytes() const { return _size; }
+    uint32_t getPublishedCount() const { return _publishedCount; }
+    uint32_t getFailedCount() const { return _failedCount; }
+    uint32_t getDropCount() const { return _dropCount; }
+    // Messages per minute of the last flush
+    uint32_t getDrainRate() const { return _drainRate; }
+
+private:
+    void dropHead();
+
+    Sodaq_R4X& _r4x;
+
+    uint8_t  _buffer[SODAQ_MQTT_QUEUE_SIZE];
+    size_t   _size;
+    uint16_t _count;
+
+    uint32_t _flushInterval;
+    size_t   _watermark;
+    uint32_t _lastFlush;
+
+    uint32_t _publishedCount;
+    uint32_t _failedCount;
+    uint32_t _dropCount;
+    uint32_t _drainRate;
+};
+
+#endif /* _SODAQ_MQTTQUEUE_H */
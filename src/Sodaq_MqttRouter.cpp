@@ -0,0 +1,238 @@
+/*
+Copyright (c) 2019, SODAQ
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "Sodaq_MqttRouter.h"
+
+#define NO_NODE     0xFF
+#define ROOT_NODE   0
+
+Sodaq_MqttRouter::Sodaq_MqttRouter()
+{
+    clear();
+}
+
+void Sodaq_MqttRouter::clear()
+{
+    memset(&_nodes[ROOT_NODE], 0, sizeof(_nodes[ROOT_NODE]));
+    _nodes[ROOT_NODE].child = NO_NODE;
+    _nodes[ROOT_NODE].sibling = NO_NODE;
+
+    _nodeCount = 1;
+    _namesSize = 0;
+}
+
+/**
+ * Add a topic filter
+ *
+ * Each level of the filter becomes a node in the trie. Levels that are
+ * shared with earlier filters reuse the existing nodes.
+ * A wildcard must fill a whole level, and '#' must be the last level.
+ */
+bool Sodaq_MqttRouter::add(const char* filter, MessageHandlerPtr handler)
+{
+    if (filter == NULL || *filter == 0 || handler == NULL) {
+        return false;
+    }
+
+    uint8_t node = ROOT_NODE;
+    const char* level = filter;
+
+    while (true) {
+        const char* end = strchr(level, '/');
+        size_t size = end ? (size_t)(end - level) : strlen(level);
+
+        if ((memchr(level, '+', size) && size != 1) ||
+            (memchr(level, '#', size) && (size != 1 || end != NULL))) {
+            return false;
+        }
+
+        uint8_t child = findChild(node, level, size);
+        if (child == NO_NODE) {
+            child = addChild(node, level, size);
+            if (child == NO_NODE) {
+                return false;
+            }
+        }
+        node = child;
+
+        if (end == NULL) {
+            break;
+        }
+        level = end + 1;
+    }
+
+    _nodes[node].handler = handler;
+
+    return true;
+}
+
+/**
+ * Remove a topic filter
+ *
+ * The nodes stay in the trie, only the handler is removed. Adding the
+ * filter again will reuse them.
+ */
+bool Sodaq_MqttRouter::remove(const char* filter)
+{
+    uint8_t node = findNode(filter);
+    if (node == NO_NODE || _nodes[node].handler == NULL) {
+        return false;
+    }
+
+    _nodes[node].handler = NULL;
+
+    return true;
+}
+
+uint8_t Sodaq_MqttRouter::dispatch(const mqtt_message_t* msg)
+{
+    if (msg == NULL || msg->topic == NULL) {
+        return 0;
+    }
+
+    return match(ROOT_NODE, msg->topic, msg);
+}
+
+/**
+ * Match the topic levels starting at "level" against the children of "parent"
+ *
+ * Per the MQTT specification topics starting with '$' are not matched by
+ * a wildcard in the first level, and "a/#" also matches "a".
+ */
+uint8_t Sodaq_MqttRouter::match(uint8_t parent, const char* level, const mqtt_message_t* msg)
+{
+    const char* end = strchr(level, '/');
+    size_t size = end ? (size_t)(end - level) : strlen(level);
+    bool noWildcard = (parent == ROOT_NODE) && (level[0] == '$');
+    uint8_t count = 0;
+
+    for (uint8_t child = _nodes[parent].child; child != NO_NODE; child = _nodes[child].sibling) {
+        const node_t& n = _nodes[child];
+
+        if (isNode(child, "#")) {
+            if (!noWildcard && n.handler) {
+                n.handler(msg);
+                count++;
+            }
+            continue;
+        }
+
+        if (isNode(child, "+")) {
+            if (noWildcard) {
+                continue;
+            }
+        }
+        else if (n.nameSize != size || memcmp(&_names[n.name], level, size) != 0) {
+            continue;
+        }
+
+        if (end != NULL) {
+            count += match(child, end + 1, msg);
+            continue;
+        }
+
+        if (n.handler) {
+            n.handler(msg);
+            count++;
+        }
+
+        for (uint8_t grandChild = n.child; grandChild != NO_NODE; grandChild = _nodes[grandChild].sibling) {
+            if (isNode(grandChild, "#") && _nodes[grandChild].handler) {
+                _nodes[grandChild].handler(msg);
+                count++;
+            }
+        }
+    }
+
+    return count;
+}
+
+uint8_t Sodaq_MqttRouter::findNode(const char* filter) const
+{
+    if (filter == NULL || *filter == 0) {
+        return NO_NODE;
+    }
+
+    uint8_t node = ROOT_NODE;
+    const char* level = filter;
+
+    while (node != NO_NODE) {
+        const char* end = strchr(level, '/');
+        size_t size = end ? (size_t)(end - level) : strlen(level);
+
+        node = findChild(node, level, size);
+
+        if (end == NULL) {
+            break;
+        }
+        level = end + 1;
+    }
+
+    return node;
+}
+
+uint8_t Sodaq_MqttRouter::findChild(uint8_t parent, const char* name, size_t size) const
+{
+    for (uint8_t child = _nodes[parent].child; child != NO_NODE; child = _nodes[child].sibling) {
+        if (_nodes[child].nameSize == size && memcmp(&_names[_nodes[child].name], name, size) == 0) {
+            return child;
+        }
+    }
+
+    return NO_NODE;
+}
+
+uint8_t Sodaq_MqttRouter::addChild(uint8_t parent, const char* name, size_t size)
+{
+    if (_nodeCount >= SODAQ_MQTT_ROUTER_MAX_NODES || _namesSize + size > sizeof(_names) || size > 0xFF) {
+        return NO_NODE;
+    }
+
+    uint8_t child = _nodeCount++;
+    node_t& n = _nodes[child];
+
+    memcpy(&_names[_namesSize], name, size);
+    n.name = _namesSize;
+    n.nameSize = size;
+    _namesSize += size;
+
+    n.handler = NULL;
+    n.child = NO_NODE;
+    n.sibling = _nodes[parent].child;
+    _nodes[parent].child = child;
+
+    return child;
+}
+
+bool Sodaq_MqttRouter::isNode(uint8_t node, const char* name) const
+{
+    return _nodes[node].nameSize == 1 && _names[_nodes[node].name] == name[0];
+}
@@ -0,0 +1,88 @@
+/*
+Copyright (c) 2019, SODAQ
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _SODAQ_MQTTROUTER_H
+#define _SODAQ_MQTTROUTER_H
+
+#include <stdint.h>
+
+#include "Sodaq_R4X.h"
+
+#define SODAQ_MQTT_ROUTER_MAX_NODES     64
+#define SODAQ_MQTT_ROUTER_NAMES_SIZE    512
+
+/**
+ * Routes received MQTT messages to a handler per topic filter
+ *
+ * The topic filters may contain the wildcards '+' (one level) and '#' (all
+ * remaining levels). The filters are stored as a trie of topic levels, so
+ * that a received topic is matched against all filters in a single walk.
+ * The handlers of all matching filters are called.
+ */
+class Sodaq_MqttRouter
+{
+public:
+    Sodaq_MqttRouter();
+
+    // Adds (or replaces) the handler of a topic filter.
+    // Returns false if the filter is invalid or the router is full.
+    bool add(const char* filter, MessageHandlerPtr handler);
+    bool remove(const char* filter);
+    void clear();
+
+    // Calls the handlers of all filters matching the topic of the message.
+    // Returns the number of called handlers.
+    uint8_t dispatch(const mqtt_message_t* msg);
+
+private:
+    typedef struct
+    {
+        MessageHandlerPtr handler;
+        uint16_t name;          //< Offset of the level name in _names
+        uint8_t  nameSize;
+        uint8_t  child;         //< First child node
+        uint8_t  sibling;       //< Next node with the same parent
+    } node_t;
+
+    uint8_t findChild(uint8_t parent, const char* name, size_t size) const;
+    uint8_t addChild(uint8_t parent, const char* name, size_t size);
+    uint8_t findNode(const char* filter) const;
+    uint8_t match(uint8_t parent, const char* level, const mqtt_message_t* msg);
+    bool    isNode(uint8_t node, const char* name) const;
+
+    node_t   _nodes[SODAQ_MQTT_ROUTER_MAX_NODES];
+    uint8_t  _nodeCount;
+
+    char     _names[SODAQ_MQTT_ROUTER_NAMES_SIZE];
+    uint16_t _namesSize;
+};
+
+#endif /* _SODAQ_MQTTROUTER_H */
@@ -0,0 +1,756 @@
+/*
+Copyright (c) 2019, SODAQ
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "Sodaq_MqttSn.h"
+
+/**
+ * MQTT-SN message types
+ */
+#define MQTTSN_CONNECT          0x04
+#define MQTTSN_CONNACK          0x05
+#define MQTTSN_REGISTER         0x0A
+#define MQTTSN_REGACK           0x0B
+#define MQTTSN_PUBLISH          0x0C
+#define MQTTSN_PUBACK           0x0D
+#define MQTTSN_SUBSCRIBE        0x12
+#define MQTTSN_SUBACK           0x13
+#define MQTTSN_UNSUBSCRIBE      0x14
+#define MQTTSN_UNSUBACK         0x15
+#define MQTTSN_PINGREQ          0x16
+#define MQTTSN_PINGRESP         0x17
+#define MQTTSN_DISCONNECT       0x18
+
+/**
+ * MQTT-SN flags
+ */
+#define MQTTSN_FLAG_DUP         0x80
+#define MQTTSN_FLAG_QOS_0       0x00
+#define MQTTSN_FLAG_QOS_1       0x20
+#define MQTTSN_FLAG_QOS_M1      0x60
+#define MQTTSN_FLAG_RETAIN      0x10
+#define MQTTSN_FLAG_CLEAN       0x04
+#define MQTTSN_FLAG_TOPIC_TYPE  0x03
+
+#define MQTTSN_PROTOCOL_ID      0x01
+
+#define MQTTSN_RC_ACCEPTED      0x00
+#define MQTTSN_RC_INVALID_TOPIC 0x02
+
+// Room for the long form of the header: 0x01, length (2 bytes), type
+#define MQTTSN_MAX_HEADER_SIZE  4
+
+static inline bool is_timedout(uint32_t from, uint32_t nr_ms) __attribute__((always_inline));
+static inline bool is_timedout(uint32_t from, uint32_t nr_ms) { return (millis() - from) > nr_ms; }
+
+static inline uint8_t* put_be16(uint8_t* p, uint16_t v) { p[0] = v >> 8; p[1] = v & 0xFF; return p + 2; }
+static inline uint16_t get_be16(const uint8_t* p) { return (p[0] << 8) | p[1]; }
+
+Sodaq_MqttSn::Sodaq_MqttSn(Sodaq_Ublox& modem) : _modem(modem)
+{
+    _host = 0;
+    _port = SODAQ_MQTTSN_DEFAULT_PORT;
+    _socket = -1;
+
+    _clientId[0] = 0;
+    _keepAlive = SODAQ_MQTTSN_DEFAULT_KEEPALIVE;
+    _retryTimeout = SODAQ_MQTTSN_DEFAULT_RETRY_TIMEOUT;
+    _retryCount = SODAQ_MQTTSN_DEFAULT_RETRY_COUNT;
+    _connected = false;
+    _lastSend = 0;
+    _msgId = 0;
+
+    _handler = 0;
+
+    _ackType = 0;
+    _ackMsgId = 0;
+    _ackReceived = false;
+    _ackReturnCode = 0;
+    _ackTopicId = 0;
+    _publishReceived = 0;
+    _pingOutstanding = false;
+    _pingSent = 0;
+    _pingRetries = 0;
+
+    _topicCount = 0;
+
+    _txPacket = _txBuffer;
+    _txSize = 0;
+
+    resetStatistics();
+}
+
+void Sodaq_MqttSn::setClientId(const char* id)
+{
+    strncpy(_clientId, id, sizeof(_clientId) - 1);
+    _clientId[sizeof(_clientId) - 1] = 0;
+}
+
+void Sodaq_MqttSn::resetStatistics()
+{
+    _bytesSent = 0;
+    _bytesReceived = 0;
+    _packetsSent = 0;
+    _packetsReceived = 0;
+}
+
+bool Sodaq_MqttSn::connect(bool cleanSession)
+{
+    if (!openSocket()) {
+        return false;
+    }
+
+    _connected = false;
+    _pingOutstanding = false;
+
+    if (cleanSession) {
+        _topicCount = 0;
+    }
+
+    uint8_t* p = startPacket();
+    *p++ = cleanSession ? MQTTSN_FLAG_CLEAN : 0;
+    *p++ = MQTTSN_PROTOCOL_ID;
+    p = put_be16(p, _keepAlive);
+    memcpy(p, _clientId, strlen(_clientId));
+    p += strlen(_clientId);
+
+    if (!request(MQTTSN_CONNECT, p, MQTTSN_CONNACK, 0) || _ackReturnCode != MQTTSN_RC_ACCEPTED) {
+        return false;
+    }
+
+    _connected = true;
+
+    return true;
+}
+
+bool Sodaq_MqttSn::disconnect()
+{
+    if (_socket < 0) {
+        return true;
+    }
+
+    bool retval = request(MQTTSN_DISCONNECT, startPacket(), MQTTSN_DISCONNECT, 0);
+
+    _connected = false;
+    _modem.socketClose(_socket);
+    _socket = -1;
+
+    return retval;
+}
+
+/**
+ * Go to sleep
+ *
+ * A DISCONNECT with a duration keeps the session at the gateway, and the
+ * gateway buffers the messages until the next wake().
+ * The socket is closed, it does not need to survive the PSM of the modem.
+ */
+bool Sodaq_MqttSn::sleep(uint16_t duration)
+{
+    if (!_connected) {
+        return false;
+    }
+
+    uint8_t* p = startPacket();
+    p = put_be16(p, duration);
+
+    bool retval = request(MQTTSN_DISCONNECT, p, MQTTSN_DISCONNECT, 0);
+
+    _connected = false;
+    _modem.socketClose(_socket);
+    _socket = -1;
+
+    return retval;
+}
+
+/**
+ * Fetch the buffered messages after sleeping
+ *
+ * A PINGREQ with the client ID makes the gateway send the buffered messages,
+ * followed by a PINGRESP. After that the client is asleep again. Use
+ * connect(false) to become active.
+ */
+bool Sodaq_MqttSn::wake()
+{
+    if (!openSocket()) {
+        return false;
+    }
+
+    uint8_t* p = startPacket();
+    memcpy(p, _clientId, strlen(_clientId));
+    p += strlen(_clientId);
+
+    return request(MQTTSN_PINGREQ, p, MQTTSN_PINGRESP, 0);
+}
+
+bool Sodaq_MqttSn::ping()
+{
+    if (!openSocket()) {
+        return false;
+    }
+
+    return request(MQTTSN_PINGREQ, startPacket(), MQTTSN_PINGRESP, 0);
+}
+
+uint16_t Sodaq_MqttSn::registerTopic(const char* topic)
+{
+    int8_t ix = findTopic(topic);
+    if (ix >= 0) {
+        return _topics[ix].id;
+    }
+
+    size_t length = strlen(topic);
+    if (!_connected || length > SODAQ_MQTTSN_MAX_TOPIC_LENGTH) {
+        return 0;
+    }
+
+    uint16_t msgId = nextMsgId();
+
+    uint8_t* p = startPacket();
+    p = put_be16(p, 0);
+    p = put_be16(p, msgId);
+    memcpy(p, topic, length);
+    p += length;
+
+    if (!request(MQTTSN_REGISTER, p, MQTTSN_REGACK, msgId) || _ackReturnCode != MQTTSN_RC_ACCEPTED) {
+        return 0;
+    }
+
+    addTopic(topic, _ackTopicId);
+
+    return _ackTopicId;
+}
+
+bool Sodaq_MqttSn::publish(const char* topic, const uint8_t* msg, size_t size, int8_t qos, bool retain)
+{
+    // Short topic names are sent as the topic ID itself
+    if (strlen(topic) == 2) {
+        return publish(get_be16(reinterpret_cast<const uint8_t*>(topic)), MqttSnTopicShort, msg, size, qos, retain);
+    }
+
+    int8_t ix = findTopic(topic);
+    uint16_t topicId = ix >= 0 ? _topics[ix].id : registerTopic(topic);
+    if (topicId == 0) {
+        return false;
+    }
+
+    return publish(topicId, MqttSnTopicNormal, msg, size, qos, retain);
+}
+
+bool Sodaq_MqttSn::publish(uint16_t topicId, MqttSnTopicIdTypes topicIdType, const uint8_t* msg, size_t size,
+                           int8_t qos, bool retain)
+{
+    if (size + 5 > SODAQ_MQTTSN_MAX_PACKET_SIZE - MQTTSN_MAX_HEADER_SIZE) {
+        return false;
+    }
+
+    if (qos < -1 || qos > 1 || (qos == -1 && topicIdType == MqttSnTopicNormal)) {
+        return false;
+    }
+
+    if (qos >= 0 && !_connected) {
+        return false;
+    }
+
+    if (!openSocket()) {
+        return false;
+    }
+
+    uint16_t msgId = (qos == 1) ? nextMsgId() : 0;
+
+    uint8_t* p = startPacket();
+    *p++ = (qos == 1 ? MQTTSN_FLAG_QOS_1 : (qos == 0 ? MQTTSN_FLAG_QOS_0 : MQTTSN_FLAG_QOS_M1)) |
+           (retain ? MQTTSN_FLAG_RETAIN : 0) | topicIdType;
+    p = put_be16(p, topicId);
+    p = put_be16(p, msgId);
+    memcpy(p, msg, size);
+    p += size;
+
+    if (qos < 1) {
+        return sendPacket(MQTTSN_PUBLISH, p);
+    }
+
+    return request(MQTTSN_PUBLISH, p, MQTTSN_PUBACK, msgId) && (_ackReturnCode == MQTTSN_RC_ACCEPTED);
+}
+
+bool Sodaq_MqttSn::subscribe(const char* filter, uint8_t qos)
+{
+    size_t length = strlen(filter);
+    if (!_connected || length > SODAQ_MQTTSN_MAX_TOPIC_LENGTH) {
+        return false;
+    }
+
+    uint16_t msgId = nextMsgId();
+
+    uint8_t* p = startPacket();
+    *p++ = (qos > 0 ? MQTTSN_FLAG_QOS_1 : MQTTSN_FLAG_QOS_0) | MqttSnTopicNormal;
+    p = put_be16(p, msgId);
+    memcpy(p, filter, length);
+    p += length;
+
+    if (!request(MQTTSN_SUBSCRIBE, p, MQTTSN_SUBACK, msgId) || _ackReturnCode != MQTTSN_RC_ACCEPTED) {
+        return false;
+    }
+
+    // The gateway registers the topics of a wildcard filter when they are published
+    if (_ackTopicId != 0 && !strpbrk(filter, "+#")) {
+        addTopic(filter, _ackTopicId);
+    }
+
+    return true;
+}
+
+bool Sodaq_MqttSn::unsubscribe(const char* filter)
+{
+    size_t length = strlen(filter);
+    if (!_connected || length > SODAQ_MQTTSN_MAX_TOPIC_LENGTH) {
+        return false;
+    }
+
+    uint16_t msgId = nextMsgId();
+
+    uint8_t* p = startPacket();
+    *p++ = MqttSnTopicNormal;
+    p = put_be16(p, msgId);
+    memcpy(p, filter, length);
+    p += length;
+
+    return request(MQTTSN_UNSUBSCRIBE, p, MQTTSN_UNSUBACK, msgId);
+}
+
+size_t Sodaq_MqttSn::loop()
+{
+    if (_socket < 0) {
+        return 0;
+    }
+
+    _publishReceived = 0;
+    while (_modem.socketHasPendingBytes(_socket)) {
+        if (!receivePacket()) {
+            break;
+        }
+    }
+
+    size_t count = _publishReceived;
+
+    if (!_connected || _keepAlive == 0) {
+        _pingOutstanding = false;
+    }
+    else if (_pingOutstanding) {
+        if (is_timedout(_pingSent, _retryTimeout)) {
+            if (_pingRetries >= _retryCount) {
+                // No PINGRESP, the gateway is lost
+                _pingOutstanding = false;
+                _connected = false;
+            }
+            else {
+                _pingRetries++;
+                sendPing();
+            }
+        }
+    }
+    else if (is_timedout(_lastSend, _keepAlive * 750UL)) {
+        // Ping before the gateway considers the client lost
+        _pingRetries = 0;
+        sendPing();
+    }
+
+    return count;
+}
+
+/******************************************************************************
+* Private
+*****************************************************************************/
+
+bool Sodaq_MqttSn::openSocket()
+{
+    if (_socket >= 0) {
+        return true;
+    }
+
+    if (_host == 0) {
+        return false;
+    }
+
+    _socket = _modem.socketCreate(0, UbloxUDP);
+
+    return _socket >= 0;
+}
+
+/**
+ * Send the keepalive ping of loop() without waiting for the PINGRESP
+ *
+ * A ping that could not be sent is retried like a lost one.
+ */
+void Sodaq_MqttSn::sendPing()
+{
+    _pingOutstanding = true;
+    _pingSent = millis();
+
+    sendPacket(MQTTSN_PINGREQ, startPacket());
+}
+
+/**
+ * Start a new packet in the transmit buffer
+ *
+ * Returns where the body of the packet starts. The header is filled in
+ * by sendPacket(), when the size is known.
+ */
+uint8_t* Sodaq_MqttSn::startPacket()
+{
+    return _txBuffer + MQTTSN_MAX_HEADER_SIZE;
+}
+
+bool Sodaq_MqttSn::sendPacket(uint8_t type, const uint8_t* end)
+{
+    size_t size = end - (_txBuffer + MQTTSN_MAX_HEADER_SIZE) + 2;
+
+    if (size < 0x100) {
+        _txPacket = _txBuffer + 2;
+        _txPacket[0] = size;
+        _txPacket[1] = type;
+    }
+    else {
+        size += 2;
+        _txPacket = _txBuffer;
+        _txPacket[0] = 0x01;
+        put_be16(&_txPacket[1], size);
+        _txPacket[3] = type;
+    }
+    _txSize = size;
+
+    return resendPacket();
+}
+
+bool Sodaq_MqttSn::resendPacket()
+{
+    _lastSend = millis();
+
+    if (_modem.socketSend(_socket, _host, _port, _txPacket, _txSize) != _txSize) {
+        return false;
+    }
+
+    _bytesSent += _txSize;
+    _packetsSent++;
+
+    return true;
+}
+
+/**
+ * Send the packet and wait for the acknowledgement
+ *
+ * The packet is retransmitted when no acknowledgement arrived in time,
+ * with the DUP flag set where the protocol has one.
+ */
+bool Sodaq_MqttSn::request(uint8_t type, const uint8_t* end, uint8_t ackType, uint16_t msgId)
+{
+    if (!sendPacket(type, end)) {
+        return false;
+    }
+
+    for (uint8_t retry = 0; ; retry++) {
+        if (waitFor(ackType, msgId, _retryTimeout)) {
+            return true;
+        }
+
+        if (retry >= _retryCount) {
+            break;
+        }
+
+        if (type == MQTTSN_PUBLISH || type == MQTTSN_SUBSCRIBE) {
+            _txBuffer[MQTTSN_MAX_HEADER_SIZE] |= MQTTSN_FLAG_DUP;
+        }
+
+        if (!resendPacket()) {
+            return false;
+        }
+    }
+
+    return false;
+}
+
+bool Sodaq_MqttSn::waitFor(uint8_t ackType, uint16_t msgId, uint32_t timeout)
+{
+    uint32_t start = millis();
+
+    _ackType = ackType;
+    _ackMsgId = msgId;
+    _ackReceived = false;
+    _ackReturnCode = 0;
+    _ackTopicId = 0;
+
+    while (!_ackReceived && !is_timedout(start, timeout)) {
+        uint32_t elapsed = millis() - start;
+
+        if (_modem.socketWaitForReceive(_socket, timeout > elapsed ? timeout - elapsed : 0)) {
+            receivePacket();
+        }
+    }
+
+    _ackType = 0;
+
+    return _ackReceived;
+}
+
+bool Sodaq_MqttSn::receivePacket()
+{
+    size_t size = _modem.socketReceive(_socket, _rxBuffer, sizeof(_rxBuffer));
+    if (size == 0) {
+        return false;
+    }
+
+    _bytesReceived += size;
+    _packetsReceived++;
+
+    handlePacket(_rxBuffer, size);
+
+    return true;
+}
+
+void Sodaq_MqttSn::handlePacket(const uint8_t* packet, size_t size)
+{
+    size_t length;
+    uint8_t type;
+    const uint8_t* body;
+
+    if (size >= 4 && packet[0] == 0x01) {
+        length = get_be16(&packet[1]);
+        type = packet[3];
+        body = &packet[4];
+        if (length < 4 || length > size) {
+            return;
+        }
+        length -= 4;
+    }
+    else if (size >= 2) {
+        length = packet[0];
+        type = packet[1];
+        body = &packet[2];
+        if (length < 2 || length > size) {
+            return;
+        }
+        length -= 2;
+    }
+    else {
+        return;
+    }
+
+    uint16_t msgId = 0;
+    bool isAck = false;
+
+    switch (type) {
+    case MQTTSN_CONNACK:
+        if (length >= 1) {
+            _ackReturnCode = body[0];
+            isAck = true;
+        }
+        break;
+
+    case MQTTSN_REGISTER:
+        if (length >= 4) {
+            char topic[SODAQ_MQTTSN_MAX_TOPIC_LENGTH + 1];
+            size_t topicLength = min(length - 4, (size_t)SODAQ_MQTTSN_MAX_TOPIC_LENGTH);
+            memcpy(topic, &body[4], topicLength);
+            topic[topicLength] = 0;
+
+            bool added = addTopic(topic, get_be16(&body[0]));
+
+            uint8_t regack[] = { 7, MQTTSN_REGACK, body[0], body[1], body[2], body[3],
+                                 (uint8_t)(added ? MQTTSN_RC_ACCEPTED : 0x01) };
+            if (_modem.socketSend(_socket, _host, _port, regack, sizeof(regack)) == sizeof(regack)) {
+                _bytesSent += sizeof(regack);
+                _packetsSent++;
+            }
+        }
+        break;
+
+    case MQTTSN_REGACK:
+    case MQTTSN_PUBACK:
+        if (length >= 5) {
+            _ackTopicId = get_be16(&body[0]);
+            msgId = get_be16(&body[2]);
+            _ackReturnCode = body[4];
+            isAck = true;
+        }
+        break;
+
+    case MQTTSN_SUBACK:
+        if (length >= 6) {
+            _ackTopicId = get_be16(&body[1]);
+            msgId = get_be16(&body[3]);
+            _ackReturnCode = body[5];
+            isAck = true;
+        }
+        break;
+
+    case MQTTSN_UNSUBACK:
+        if (length >= 2) {
+            msgId = get_be16(&body[0]);
+            isAck = true;
+        }
+        break;
+
+    case MQTTSN_PUBLISH:
+        handlePublish(body, length);
+        break;
+
+    case MQTTSN_PINGRESP:
+        _pingOutstanding = false;
+        isAck = true;
+        break;
+
+    case MQTTSN_DISCONNECT:
+        isAck = true;
+        if (_ackType != MQTTSN_DISCONNECT) {
+            // Disconnected by the gateway
+            _connected = false;
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    if (isAck && type == _ackType && msgId == _ackMsgId) {
+        _ackReceived = true;
+    }
+}
+
+/**
+ * Handle a PUBLISH from the gateway
+ *
+ * The topic name is looked up with the topic ID. A predefined topic ID
+ * has no name, it is passed to the handler as a decimal string.
+ */
+void Sodaq_MqttSn::handlePublish(const uint8_t* body, size_t size)
+{
+    if (size < 5) {
+        return;
+    }
+
+    uint8_t flags = body[0];
+    uint16_t topicId = get_be16(&body[1]);
+    uint8_t topicIdType = flags & MQTTSN_FLAG_TOPIC_TYPE;
+    bool qos1 = (flags & MQTTSN_FLAG_QOS_M1) == MQTTSN_FLAG_QOS_1;
+
+    char topic[SODAQ_MQTTSN_MAX_TOPIC_LENGTH + 1];
+    uint8_t returnCode = MQTTSN_RC_ACCEPTED;
+
+    if (topicIdType == MqttSnTopicShort) {
+        topic[0] = body[1];
+        topic[1] = body[2];
+        topic[2] = 0;
+    }
+    else if (topicIdType == MqttSnTopicPredefined) {
+        snprintf(topic, sizeof(topic), "%u", topicId);
+    }
+    else {
+        int8_t ix = findTopic(topicId);
+        if (ix >= 0) {
+            strcpy(topic, _topics[ix].name);
+        }
+        else {
+            returnCode = MQTTSN_RC_INVALID_TOPIC;
+        }
+    }
+
+    if (returnCode == MQTTSN_RC_ACCEPTED) {
+        // Let loop() know a message was received
+        _publishReceived++;
+
+        if (_handler) {
+            mqtt_message_t msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.topic = topic;
+            msg.payload = &body[5];
+            msg.size = size - 5;
+            msg.length = msg.size;
+            msg.qos = qos1 ? 1 : 0;
+            msg.last = true;
+
+            _handler(&msg);
+        }
+    }
+
+    if (qos1 || returnCode != MQTTSN_RC_ACCEPTED) {
+        uint8_t puback[] = { 7, MQTTSN_PUBACK, body[1], body[2], body[3], body[4], returnCode };
+        if (_modem.socketSend(_socket, _host, _port, puback, sizeof(puback)) == sizeof(puback)) {
+            _bytesSent += sizeof(puback);
+            _packetsSent++;
+        }
+    }
+}
+
+uint16_t Sodaq_MqttSn::nextMsgId()
+{
+    if (++_msgId == 0) {
+        _msgId = 1;
+    }
+
+    return _msgId;
+}
+
+int8_t Sodaq_MqttSn::findTopic(const char* topic) const
+{
+    for (uint8_t ix = 0; ix < _topicCount; ix++) {
+        if (strcmp(_topics[ix].name, topic) == 0) {
+            return ix;
+        }
+    }
+
+    return -1;
+}
+
+int8_t Sodaq_MqttSn::findTopic(uint16_t topicId) const
+{
+    for (uint8_t ix = 0; ix < _topicCount; ix++) {
+        if (_topics[ix].id == topicId) {
+            return ix;
+        }
+    }
+
+    return -1;
+}
+
+bool Sodaq_MqttSn::addTopic(const char* topic, uint16_t topicId)
+{
+    int8_t ix = findTopic(topic);
+    if (ix < 0) {
+        if (_topicCount >= SODAQ_MQTTSN_MAX_TOPICS || strlen(topic) > SODAQ_MQTTSN_MAX_TOPIC_LENGTH) {
+            return false;
+        }
+        ix = _topicCount++;
+        strcpy(_topics[ix].name, topic);
+    }
+
+    _topics[ix].id = topicId;
+
+    return true;
+}
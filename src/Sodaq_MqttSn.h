@@ -0,0 +1,187 @@
+/*
+Copyright (c) 2019, SODAQ
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _SODAQ_MQTTSN_H
+#define _SODAQ_MQTTSN_H
+
+#include <stdint.h>
+
+#include "Sodaq_R4X.h"
+
+#ifndef SODAQ_MQTTSN_MAX_PACKET_SIZE
+#define SODAQ_MQTTSN_MAX_PACKET_SIZE    256
+#endif
+
+#define SODAQ_MQTTSN_MAX_TOPICS         8
+#define SODAQ_MQTTSN_MAX_TOPIC_LENGTH   48
+#define SODAQ_MQTTSN_MAX_CLIENT_ID      23
+
+#define SODAQ_MQTTSN_DEFAULT_PORT       1883
+#define SODAQ_MQTTSN_DEFAULT_KEEPALIVE  600
+#define SODAQ_MQTTSN_DEFAULT_RETRY_TIMEOUT  (10L * 1000)
+#define SODAQ_MQTTSN_DEFAULT_RETRY_COUNT    3
+
+enum MqttSnTopicIdTypes {
+    MqttSnTopicNormal = 0,
+    MqttSnTopicPredefined = 1,
+    MqttSnTopicShort = 2,
+};
+
+/**
+ * MQTT-SN (MQTT for Sensor Networks, version 1.2) client
+ *
+ * The client talks to an MQTT-SN gateway over a UDP socket of the modem.
+ * Topic names are registered once and then published by their 2 byte
+ * topic ID. Messages that need an acknowledgement (QoS 1) are retransmitted
+ * after the retry timeout.
+ *
+ * QoS -1 publishes to a predefined topic ID or a short (2 character) topic
+ * name without being connected.
+ *
+ * A sleeping client announces the sleep duration with sleep(), which should
+ * match the PSM periodic update timer of the modem. The gateway buffers the
+ * messages for it. After waking up, wake() fetches them.
+ *
+ * loop() must be called regularly to handle received messages and to send
+ * the keepalive pings. The URCs of the modem must be handled as well, for
+ * example with poll().
+ */
+class Sodaq_MqttSn
+{
+public:
+    Sodaq_MqttSn(Sodaq_Ublox& modem);
+
+    void setGateway(const char* host, uint16_t port = SODAQ_MQTTSN_DEFAULT_PORT) { _host = host; _port = port; }
+    void setClientId(const char* id);
+    void setKeepAlive(uint16_t seconds) { _keepAlive = seconds; }
+    void setRetry(uint32_t timeout, uint8_t count) { _retryTimeout = timeout; _retryCount = count; }
+    void setMessageHandler(MessageHandlerPtr handler) { _handler = handler; }
+
+    bool connect(bool cleanSession = true);
+    bool disconnect();
+    bool isConnected() const { return _connected; }
+
+    // Tells the gateway to buffer the messages for "duration" seconds.
+    bool sleep(uint16_t duration);
+    // Fetches the messages that were buffered while sleeping.
+    bool wake();
+    bool ping();
+
+    // Returns the topic ID of the topic name, 0 if the registration failed.
+    uint16_t registerTopic(const char* topic);
+
+    // QoS is -1, 0 or 1. The topic name is registered first if needed.
+    bool publish(const char* topic, const uint8_t* msg, size_t size, int8_t qos = 0, bool retain = false);
+    bool publish(uint16_t topicId, MqttSnTopicIdTypes topicIdType, const uint8_t* msg, size_t size,
+                 int8_t qos = 0, bool retain = false);
+
+    bool subscribe(const char* filter, uint8_t qos = 0);
+    bool unsubscribe(const char* filter);
+
+    // Handles the received packets and sends a ping when the keepalive
+    // period is almost over. Does not wait for the gateway: the PINGRESP is
+    // handled by a later call, a missing one is retried after the retry
+    // timeout. After the last retry the client is disconnected.
+    // Returns the number of received messages.
+    size_t loop();
+
+    // Statistics of the MQTT-SN packets (without UDP/IP headers)
+    uint32_t getBytesSent() const { return _bytesSent; }
+    uint32_t getBytesReceived() const { return _bytesReceived; }
+    uint32_t getPacketsSent() const { return _packetsSent; }
+    uint32_t getPacketsReceived() const { return _packetsReceived; }
+    void     resetStatistics();
+
+private:
+    uint8_t* startPacket();
+    bool     sendPacket(uint8_t type, const uint8_t* end);
+    bool     resendPacket();
+    bool     request(uint8_t type, const uint8_t* end, uint8_t ackType, uint16_t msgId);
+    bool     waitFor(uint8_t ackType, uint16_t msgId, uint32_t timeout);
+    bool     receivePacket();
+    void     handlePacket(const uint8_t* packet, size_t size);
+    void     handlePublish(const uint8_t* body, size_t size);
+    bool     openSocket();
+    void     sendPing();
+
+    uint16_t nextMsgId();
+    int8_t   findTopic(const char* topic) const;
+    int8_t   findTopic(uint16_t topicId) const;
+    bool     addTopic(const char* topic, uint16_t topicId);
+
+    Sodaq_Ublox& _modem;
+
+    const char* _host;
+    uint16_t    _port;
+    int         _socket;
+
+    char        _clientId[SODAQ_MQTTSN_MAX_CLIENT_ID + 1];
+    uint16_t    _keepAlive;
+    uint32_t    _retryTimeout;
+    uint8_t     _retryCount;
+    bool        _connected;
+    uint32_t    _lastSend;
+    uint16_t    _msgId;
+
+    MessageHandlerPtr _handler;
+
+    // The acknowledgement that is waited for
+    uint8_t     _ackType;
+    uint16_t    _ackMsgId;
+    bool        _ackReceived;
+    uint8_t     _ackReturnCode;
+    uint16_t    _ackTopicId;
+    // The PUBLISH messages that were handled, counted by loop()
+    size_t      _publishReceived;
+    // The keepalive ping of loop() that waits for its PINGRESP
+    bool        _pingOutstanding;
+    uint32_t    _pingSent;
+    uint8_t     _pingRetries;
+
+    struct {
+        uint16_t id;
+        char     name[SODAQ_MQTTSN_MAX_TOPIC_LENGTH + 1];
+    } _topics[SODAQ_MQTTSN_MAX_TOPICS];
+    uint8_t     _topicCount;
+
+    // The last sent packet is kept for retransmission
+    uint8_t     _txBuffer[SODAQ_MQTTSN_MAX_PACKET_SIZE + 4];
+    uint8_t*    _txPacket;
+    size_t      _txSize;
+    uint8_t     _rxBuffer[SODAQ_MQTTSN_MAX_PACKET_SIZE];
+
+    uint32_t    _bytesSent;
+    uint32_t    _bytesReceived;
+    uint32_t    _packetsSent;
+    uint32_t    _packetsReceived;
+};
+
+#endif /* _SODAQ_MQTTSN_H */
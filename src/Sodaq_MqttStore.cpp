@@ -0,0 +1,382 @@
+/*
+Copyright (c) 2019, SODAQ
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "Sodaq_MqttStore.h"
+#include "Sodaq_Utils.h"
+#include <Sodaq_wdt.h>
+
+/**
+ * A stored message is
+ *     uint8_t  marker
+ *     uint8_t  flags: qos (bit 0..1), retain (bit 2)
+ *     uint8_t  topic size
+ *     uint16_t payload size (little endian)
+ *     topic, payload
+ */
+#define RECORD_MARKER       0xA5
+#define RECORD_HEADER_SIZE  5
+
+/**
+ * An index file is
+ *     uint16_t head segment, uint16_t tail segment, uint32_t head offset,
+ *     uint32_t generation
+ */
+#define INDEX_SIZE          12
+
+Sodaq_MqttStore::Sodaq_MqttStore(Sodaq_R4X& r4x) : _r4x(r4x)
+{
+    _loaded = false;
+
+    _headSegment = 0;
+    _headOffset = 0;
+    _tailSegment = 0;
+    _tailSize = 0;
+    _indexGeneration = 0;
+}
+
+bool Sodaq_MqttStore::publish(const char* topic, const uint8_t* msg, size_t size, uint8_t qos, uint8_t retain)
+{
+    /* Don't overtake stored messages
+     */
+    if (_r4x.mqttGetLoginResult() == 0 && isEmpty() &&
+        _r4x.mqttPublish(topic, msg, size, qos, retain)) {
+        return true;
+    }
+
+    return defer(topic, msg, size, qos, retain);
+}
+
+/**
+ * Append a message to the tail segment
+ *
+ * The message is assembled in the buffer, so that it is written with a
+ * single AT+UDWNFILE.
+ */
+bool Sodaq_MqttStore::defer(const char* topic, const uint8_t* msg, size_t size, uint8_t qos, uint8_t retain)
+{
+    size_t topicSize = strlen(topic);
+    size_t recordSize = RECORD_HEADER_SIZE + topicSize + size;
+
+    if (topicSize > 0xFF || recordSize > sizeof(_buffer)) {
+        return false;
+    }
+
+    if (!load()) {
+        return false;
+    }
+
+    if (_tailSize > 0 && _tailSize + recordSize > SODAQ_MQTT_STORE_SEGMENT_SIZE) {
+        if ((uint16_t)(_tailSegment + 1 - _headSegment) >= SODAQ_MQTT_STORE_MAX_SEGMENTS) {
+            // Full
+            return false;
+        }
+
+        _tailSegment++;
+        _tailSize = 0;
+
+        if (!saveIndex()) {
+            return false;
+        }
+    }
+
+    _buffer[0] = RECORD_MARKER;
+    _buffer[1] = (qos & 0x03) | (retain ? 0x04 : 0);
+    _buffer[2] = topicSize;
+    put_le16(&_buffer[3], size);
+    memcpy(&_buffer[RECORD_HEADER_SIZE], topic, topicSize);
+    memcpy(&_buffer[RECORD_HEADER_SIZE + topicSize], msg, size);
+
+    char name[32];
+    segmentName(_tailSegment, name, sizeof(name));
+
+    if (!_r4x.writeFile(name, _buffer, recordSize)) {
+        return false;
+    }
+
+    _tailSize += recordSize;
+
+    return true;
+}
+
+uint16_t Sodaq_MqttStore::replay()
+{
+    if (!load()) {
+        return 0;
+    }
+
+    uint16_t count = 0;
+    bool done = true;
+
+    while (done && !isEmpty()) {
+        count += replaySegment(done);
+    }
+
+    saveIndex();
+
+    return count;
+}
+
+/**
+ * Publish the messages of the head segment
+ *
+ * The segment is read in blocks of the buffer size, each block can hold
+ * several messages. A completely published segment is deleted.
+ * "done" is set to false if publishing failed.
+ */
+uint16_t Sodaq_MqttStore::replaySegment(bool& done)
+{
+    char name[32];
+    segmentName(_headSegment, name, sizeof(name));
+
+    uint32_t fileSize = 0;
+    if (_headSegment == _tailSegment) {
+        fileSize = _tailSize;
+    }
+    else if (!_r4x.getFileSize(name, fileSize)) {
+        // Try again with the next replay(), do not drop the segment
+        done = false;
+        return 0;
+    }
+
+    uint16_t count = 0;
+    done = true;
+
+    while (_headOffset < fileSize) {
+        sodaq_wdt_reset();
+
+        size_t size = _r4x.readFilePartial(name, _buffer, min((uint32_t)sizeof(_buffer), fileSize - _headOffset), _headOffset);
+        if (size == 0) {
+            done = false;
+            return count;
+        }
+
+        size_t ix = 0;
+        while (ix + RECORD_HEADER_SIZE <= size) {
+            const uint8_t* record = &_buffer[ix];
+            size_t topicSize = record[2];
+            size_t msgSize = get_le16(&record[3]);
+            size_t recordSize = RECORD_HEADER_SIZE + topicSize + msgSize;
+
+            if (record[0] != RECORD_MARKER || recordSize > sizeof(_buffer)) {
+                // Corrupt, skip the rest of the segment
+                _headOffset = fileSize;
+                break;
+            }
+            if (ix + recordSize > size) {
+                // Incomplete, it is read again with the next block
+                break;
+            }
+
+            // Make the topic a C string
+            char topic[0x100];
+            memcpy(topic, &record[RECORD_HEADER_SIZE], topicSize);
+            topic[topicSize] = 0;
+
+            if (!_r4x.mqttPublish(topic, &record[RECORD_HEADER_SIZE + topicSize], msgSize,
+                                  record[1] & 0x03, (record[1] & 0x04) ? 1 : 0)) {
+                done = false;
+                return count;
+            }
+
+            count++;
+            ix += recordSize;
+            _headOffset += recordSize;
+        }
+
+        if (ix == 0 && _headOffset < fileSize) {
+            // Could not make progress, skip the rest of the segment
+            _headOffset = fileSize;
+        }
+    }
+
+    // The segment is only deleted when the saved index no longer refers to it,
+    // so the index never points to a deleted segment after a reset
+    uint16_t headSegment = _headSegment;
+    uint32_t tailSize = _tailSize;
+
+    if (_headSegment == _tailSegment) {
+        _tailSize = 0;
+    }
+    else {
+        _headSegment++;
+    }
+    _headOffset = 0;
+
+    if (!saveIndex()) {
+        // Keep the published segment, the next replay() tries again
+        _headSegment = headSegment;
+        _headOffset = fileSize;
+        _tailSize = tailSize;
+        done = false;
+        return count;
+    }
+
+    _r4x.deleteFile(name);
+
+    return count;
+}
+
+void Sodaq_MqttStore::clear()
+{
+    if (!load()) {
+        return;
+    }
+
+    uint16_t headSegment = _headSegment;
+    uint32_t headOffset = _headOffset;
+    uint16_t tailSegment = _tailSegment;
+    uint32_t tailSize = _tailSize;
+
+    // Continue in a new segment, the index no longer refers to the old ones
+    _tailSegment++;
+    _headSegment = _tailSegment;
+    _headOffset = 0;
+    _tailSize = 0;
+
+    if (!saveIndex()) {
+        _headSegment = headSegment;
+        _headOffset = headOffset;
+        _tailSegment = tailSegment;
+        _tailSize = tailSize;
+        return;
+    }
+
+    char name[32];
+    for (uint16_t segment = headSegment; segment != (uint16_t)(tailSegment + 1); segment++) {
+        segmentName(segment, name, sizeof(name));
+        _r4x.deleteFile(name);
+    }
+}
+
+bool Sodaq_MqttStore::isEmpty()
+{
+    if (!load()) {
+        return true;
+    }
+
+    return _headSegment == _tailSegment && _headOffset >= _tailSize;
+}
+
+/**
+ * Read the index and the size of the tail segment from the modem
+ *
+ * This is done once, the first time the store is used.
+ */
+bool Sodaq_MqttStore::load()
+{
+    if (_loaded) {
+        return true;
+    }
+
+    uint8_t index[2][INDEX_SIZE];
+    bool valid[2];
+
+    if (!readIndex(0, index[0], valid[0]) || !readIndex(1, index[1], valid[1])) {
+        return false;
+    }
+
+    if (valid[0] || valid[1]) {
+        // The newest of the two, taking the wrap around of the generation into account
+        uint8_t file = (valid[0] && valid[1]) ?
+                       ((int32_t)(get_le32(&index[1][8]) - get_le32(&index[0][8])) > 0) :
+                       valid[1];
+
+        _headSegment = get_le16(&index[file][0]);
+        _tailSegment = get_le16(&index[file][2]);
+        _headOffset  = get_le32(&index[file][4]);
+        _indexGeneration = get_le32(&index[file][8]);
+    }
+
+    char name[32];
+    segmentName(_tailSegment, name, sizeof(name));
+
+    if (!_r4x.getFileSize(name, _tailSize)) {
+        _tailSize = 0;
+    }
+
+    _loaded = true;
+
+    return true;
+}
+
+bool Sodaq_MqttStore::saveIndex()
+{
+    uint8_t index[INDEX_SIZE];
+    uint32_t generation = _indexGeneration + 1;
+
+    put_le16(&index[0], _headSegment);
+    put_le16(&index[2], _tailSegment);
+    put_le32(&index[4], _headOffset);
+    put_le32(&index[8], generation);
+
+    // The other file holds the current index until this one is complete
+    char name[32];
+    indexName(generation & 1, name, sizeof(name));
+
+    // writeFile() appends, so start with a new file
+    _r4x.deleteFile(name);
+
+    if (!_r4x.writeFile(name, index, sizeof(index))) {
+        return false;
+    }
+
+    _indexGeneration = generation;
+
+    return true;
+}
+
+/**
+ * Read one of the index files
+ *
+ * "valid" is set to false if the file does not exist or is incomplete.
+ * Returns false if a complete file could not be read.
+ */
+bool Sodaq_MqttStore::readIndex(uint8_t file, uint8_t* index, bool& valid)
+{
+    char name[32];
+    uint32_t size = 0;
+
+    indexName(file, name, sizeof(name));
+
+    valid = _r4x.getFileSize(name, size) && (size == INDEX_SIZE);
+
+    return !valid || (_r4x.readFile(name, index, INDEX_SIZE) == INDEX_SIZE);
+}
+
+void Sodaq_MqttStore::indexName(uint8_t file, char* name, size_t size)
+{
+    snprintf(name, size, SODAQ_MQTT_STORE_INDEX_FILENAME "%u", file);
+}
+
+void Sodaq_MqttStore::segmentName(uint16_t segment, char* name, size_t size)
+{
+    snprintf(name, size, SODAQ_MQTT_STORE_PREFIX "%u", segment);
+}
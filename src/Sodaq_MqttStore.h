@@ -0,0 +1,106 @@
+/*
+Copyright (c) 2019, SODAQ
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _SODAQ_MQTTSTORE_H
+#define _SODAQ_MQTTSTORE_H
+
+#include <stdint.h>
+
+#include "Sodaq_R4X.h"
+
+#define SODAQ_MQTT_STORE_PREFIX         "mqtt_q_"
+// The index is kept in two files, named with a 0 or 1 appended
+#define SODAQ_MQTT_STORE_INDEX_FILENAME "mqtt_q_idx"
+#define SODAQ_MQTT_STORE_SEGMENT_SIZE   4096
+#define SODAQ_MQTT_STORE_MAX_SEGMENTS   16
+#define SODAQ_MQTT_STORE_BUFFER_SIZE    512
+
+/**
+ * Store-and-forward queue for MQTT publishes
+ *
+ * Messages that cannot be published right away are appended to a log on
+ * the modem file system. The log is split in segment files. replay()
+ * publishes the stored messages in order and deletes every segment that
+ * has been published completely.
+ *
+ * The index is written to two files in turn, so a reset while one of them
+ * is written leaves the previous index in the other one.
+ *
+ * A stored message (header, topic and payload) must fit in
+ * SODAQ_MQTT_STORE_BUFFER_SIZE bytes.
+ */
+class Sodaq_MqttStore
+{
+public:
+    Sodaq_MqttStore(Sodaq_R4X& r4x);
+
+    // Publishes the message if logged in, and stores it if that fails.
+    bool publish(const char* topic, const uint8_t* msg, size_t size, uint8_t qos = 0, uint8_t retain = 0);
+
+    // Stores the message, to be published later by replay().
+    bool defer(const char* topic, const uint8_t* msg, size_t size, uint8_t qos = 0, uint8_t retain = 0);
+
+    // Publishes the stored messages in order. Stops at the first failure.
+    // Returns the number of published messages.
+    uint16_t replay();
+
+    // Deletes all stored messages.
+    void clear();
+
+    bool isEmpty();
+
+private:
+    bool load();
+    bool saveIndex();
+    bool readIndex(uint8_t file, uint8_t* index, bool& valid);
+    void indexName(uint8_t file, char* name, size_t size);
+    void segmentName(uint16_t segment, char* name, size_t size);
+    uint16_t replaySegment(bool& done);
+
+    Sodaq_R4X& _r4x;
+
+    bool     _loaded;
+
+    // The oldest segment, and the offset of the next message to publish in it
+    uint16_t _headSegment;
+    uint32_t _headOffset;
+
+    // The segment that messages are appended to
+    uint16_t _tailSegment;
+    uint32_t _tailSize;
+
+    // Incremented by every saveIndex(), the lowest bit selects the index file
+    uint32_t _indexGeneration;
+
+    uint8_t  _buffer[SODAQ_MQTT_STORE_BUFFER_SIZE];
+};
+
+#endif /* _SODAQ_MQTTSTORE_H */
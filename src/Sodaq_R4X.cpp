@@ -30,6 +30,10 @@ POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include "Sodaq_R4X.h"
+#include "Sodaq_MqttRouter.h"
+#include "Sodaq_MqttStore.h"
+#include "Sodaq_Inflate.h"
+#include "Sodaq_Utils.h"
 #include <Sodaq_wdt.h>
 
 //#define DEBUG
@@ -64,6 +68,23 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #define HTTP_RECEIVE_FILENAME  "http_last_response_0"
 #define HTTP_SEND_TMP_FILENAME "http_tmp_put_0"
+#define HTTP_RECEIVE_FILENAME_PREFIX  "http_last_response_"
+#define HTTP_SEND_TMP_FILENAME_PREFIX "http_tmp_put_"
+#define HTTP_FILENAME_SIZE     24
+#define MQTT_SEND_TMP_FILENAME "mqtt_tmp_pub"
+
+#define HTTP_ACCEPT_ENCODING_NAME  "Accept-Encoding"
+#define HTTP_ACCEPT_ENCODING_VALUE "gzip, deflate"
+
+// The delay between reads of the UART while waiting for the result of a request
+#define HTTP_URC_POLL_INTERVAL 1
+
+// AT+UHTTPC command of a POST with the body in the command
+#define HTTP_POST_DATA_COMMAND 5
+
+#define MQTT_SUBSCRIPTION_ASYNC   -3
+#define MQTT_SUBSCRIPTION_FREE    -2
+#define MQTT_SUBSCRIPTION_PENDING -1
 
 #define STR_HELPER(x) #x
 #define STR(x) STR_HELPER(x)
@@ -87,6 +108,91 @@ static inline bool is_timedout(uint32_t from, uint32_t nr_ms) { return (millis()
 
 static inline bool is_socketID_valid(int8_t socketID) { return ((socketID >= 0) && (socketID < SODAQ_UBLOX_SOCKET_COUNT)); }
 
+/**
+ * Can the MQTT payload be sent as a quoted string in AT+UMQTTC=2?
+ *
+ * Only printable ASCII is allowed, and the closing quote would end the string.
+ */
+static bool is_mqtt_text_payload(const uint8_t* msg, size_t size)
+{
+    for (size_t i = 0; i < size; i++) {
+        if (msg[i] < ' ' || msg[i] > '~' || msg[i] == '"') {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Appends the http profile to the prefix, e.g. "http_last_response_1"
+static void http_profile_filename(char* buffer, const char* prefix, uint8_t profile)
+{
+    size_t size = strlen(prefix);
+
+    memcpy(buffer, prefix, size);
+    buffer[size] = '0' + profile;
+    buffer[size + 1] = 0;
+}
+
+// Fingerprint of a custom header, 0 for an empty slot
+static uint32_t http_header_hash(const char* name, const char* value)
+{
+    if (name == NULL) {
+        return 0;
+    }
+
+    uint32_t hash = fnv1a(FNV1A_INIT, name, strlen(name) + 1);
+
+    return fnv1a(hash, value, strlen(value) + 1);
+}
+
+// Characters that are escaped as \XX in a string parameter
+static inline bool http_needs_escape(uint8_t c)
+{
+    return (c < 0x20) || (c >= 0x7F) || (c == '"') || (c == '\\');
+}
+
+// The size of the data in a string parameter
+static size_t http_escaped_size(const uint8_t* data, size_t size)
+{
+    size_t escapedSize = size;
+
+    for (size_t i = 0; i < size; i++) {
+        if (http_needs_escape(data[i])) {
+            escapedSize += 2;
+        }
+    }
+
+    return escapedSize;
+}
+
+/**
+ * Scan for the empty line at the end of an HTTP response header
+ *
+ * The state (0 nothing, 1=CR, 2=CRLF, 3=CRLFCR, 4=CRLFCRLF) is kept between
+ * calls, so the header can be scanned block by block.
+ * Returns the number of bytes up to and including the empty line, or size
+ * if the end of the header was not found.
+ */
+static size_t http_scan_header_end(const uint8_t* data, size_t size, uint8_t& state)
+{
+    size_t ix;
+
+    for (ix = 0; state != 4 && ix < size; ix++) {
+        if ((state == 0 || state == 2) && data[ix] == '\r') {
+            state++;
+        }
+        else if ((state == 1 || state == 3) && data[ix] == '\n') {
+            state++;
+        }
+        else {
+            state = 0;
+        }
+    }
+
+    return ix;
+}
+
 static uint8_t httpRequestMapping[] = {
     4, // 0 POST
     1, // 1 GET
@@ -112,6 +218,10 @@ Sodaq_R4X::Sodaq_R4X() : Sodaq_Ublox()
     _mqttSubscribeReason = -1;
     _networkStatusLED    = 0;
 
+    for (size_t ix = 0; ix < DIM(_mqttSubscriptionResult); ix++) {
+        _mqttSubscriptionResult[ix] = MQTT_SUBSCRIPTION_FREE;
+    }
+
     _pin = 0;
     _cid = SODAQ_R4X_DEFAULT_CID;
     _urat = SODAQ_R4X_DEFAULT_URAT;
@@ -121,6 +231,20 @@ Sodaq_R4X::Sodaq_R4X() : Sodaq_Ublox()
     _bandMaskNB = BAND_MASK_UNCHANGED;
 
     _httpGetHeaderSize = 0;
+    _httpContentType = HttpContentTextPlain;
+    _httpCompletionHandler = 0;
+    _httpHeaders = 0;
+    _httpInflater = 0;
+    _httpAcceptEncoding = false;
+    memset(_httpHeaderHash, 0, sizeof(_httpHeaderHash));
+    memset(_httpProfileHash, 0, sizeof(_httpProfileHash));
+    memset(_httpProfileBusy, 0, sizeof(_httpProfileBusy));
+    memset(_httpProfileHeaderSize, 0, sizeof(_httpProfileHeaderSize));
+    for (size_t ix = 0; ix < DIM(_httpProfileResult); ix++) {
+        _httpProfileResult[ix] = TriBoolUndefined;
+    }
+    memset(_httpCapturedHeaders, 0, sizeof(_httpCapturedHeaders));
+    httpResetResponse();
 
     /*
      * Assume all socket are closed
@@ -190,6 +314,10 @@ bool Sodaq_R4X::on()
     }
 
     if (was_off) {
+        // the modem forgets its http settings when it is powered off
+        memset(_httpProfileHash, 0, sizeof(_httpProfileHash));
+        memset(_httpHeaderHash, 0, sizeof(_httpHeaderHash));
+
         uint32_t baud = determineBaudRate(_baudRate);
         if (baud == 0) {
             debugPrintln("ERROR: No Reply from Modem");
@@ -1379,7 +1507,16 @@ bool Sodaq_R4X::mqttLogin(uint32_t timeout)
         mqttLoop();
     }
 
-    return (_mqttLoginResult == 0);
+    if (_mqttLoginResult != 0) {
+        return false;
+    }
+
+    // Publish what was stored while not logged in
+    if (_mqttStore) {
+        _mqttStore->replay();
+    }
+
+    return true;
 }
 
 bool Sodaq_R4X::mqttLogout()
@@ -1392,20 +1529,9 @@ bool Sodaq_R4X::mqttLogout()
     return (readResponse(buffer, sizeof(buffer), "+UMQTTC: ", _umqtt_timeout) == GSMResponseOK) && startsWith("0,1", buffer);
 }
 
-void Sodaq_R4X::mqttLoop()
+size_t Sodaq_R4X::mqttLoop()
 {
-    sodaq_wdt_reset();
-    if (_modemUART->available()) {
-
-        int count = readLn(250);        // 250ms, how many bytes at which baudrate?
-
-        if (count > 0) {
-            debugPrint("<< ");
-            debugPrintln(getInputBuffer());
-
-            checkURC(getInputBuffer());
-        }
-    }
+    return poll();
 }
 
 bool Sodaq_R4X::mqttPing(const char* server)
@@ -1421,6 +1547,22 @@ bool Sodaq_R4X::mqttPing(const char* server)
 
 bool Sodaq_R4X::mqttPublish(const char* topic, const uint8_t* msg, size_t size, uint8_t qos, uint8_t retain, bool useHEX)
 {
+    if ((useHEX ? size * 2 : size) > SODAQ_R4X_MAX_MQTT_INLINE_SIZE) {
+        // Too large for the command line, let the modem read it from a file
+        deleteFile(MQTT_SEND_TMP_FILENAME); // cleanup the file first (if exists)
+
+        if (!writeFile(MQTT_SEND_TMP_FILENAME, msg, size)) {
+            debugPrintln(DEBUG_STR_ERROR "Could not create the mqtt tmp file!");
+            return false;
+        }
+
+        return mqttPublishFromFile(topic, MQTT_SEND_TMP_FILENAME, qos, retain);
+    }
+
+    if (!useHEX && !is_mqtt_text_payload(msg, size)) {
+        return mqttPublishBinary(topic, msg, size, qos, retain);
+    }
+
     char buffer[16];
 
     print("AT+UMQTTC=2,");
@@ -1449,6 +1591,62 @@ bool Sodaq_R4X::mqttPublish(const char* topic, const uint8_t* msg, size_t size,
     return (readResponse(buffer, sizeof(buffer), "+UMQTTC: ", _umqtt_timeout) == GSMResponseOK) && startsWith("2,1", buffer);
 }
 
+/**
+ * Publish a binary message
+ *
+ * The payload is not quoted nor HEX encoded. After the '>' prompt the
+ * modem expects exactly "size" bytes.
+ */
+bool Sodaq_R4X::mqttPublishBinary(const char* topic, const uint8_t* msg, size_t size, uint8_t qos, uint8_t retain)
+{
+    if (size > SODAQ_R4X_MAX_MQTT_BINARY_SIZE) {
+        debugPrintln(DEBUG_STR_ERROR "MQTT binary message exceeded maximum size!");
+        return false;
+    }
+
+    char buffer[16];
+
+    print("AT+UMQTTC=9,");
+    print(qos);
+    print(',');
+    print(retain);
+    print(",\"");
+    print(topic);
+    print("\",");
+    println(size);
+
+    if (!waitForFilePrompt(1000)) {
+        return false;
+    }
+
+    writeBytes(msg, size);
+
+    return (readResponse(buffer, sizeof(buffer), "+UMQTTC: ", _umqtt_timeout) == GSMResponseOK) && startsWith("9,1", buffer);
+}
+
+/**
+ * Publish the contents of a file
+ *
+ * The file must already exist on the modem file system, for example
+ * written with writeFile(). The file is left unmodified.
+ */
+bool Sodaq_R4X::mqttPublishFromFile(const char* topic, const char* filename, uint8_t qos, uint8_t retain)
+{
+    char buffer[16];
+
+    print("AT+UMQTTC=3,");
+    print(qos);
+    print(',');
+    print(retain);
+    print(",\"");
+    print(topic);
+    print("\",\"");
+    print(filename);
+    println('"');
+
+    return (readResponse(buffer, sizeof(buffer), "+UMQTTC: ", _umqtt_timeout) == GSMResponseOK) && startsWith("3,1", buffer);
+}
+
 // returns number of read messages
 uint16_t Sodaq_R4X::mqttReadMessages(char* buffer, size_t size, uint32_t timeout)
 {
@@ -1468,10 +1666,7 @@ uint16_t Sodaq_R4X::mqttReadMessages(char* buffer, size_t size, uint32_t timeout
         return 0;
     }
 
-    // check URC synchronously
-    while ((_mqttPendingMessages == -1) && !is_timedout(startTime, timeout)) {
-        mqttLoop();
-    }
+    mqttWaitForPendingMessages(startTime, timeout);
 
     if (_mqttPendingMessages <= 0) {
         return 0;
@@ -1534,6 +1729,18 @@ uint16_t Sodaq_R4X::mqttReadMessages(char* buffer, size_t size, uint32_t timeout
                 if (_mqttPublishHandler) {
                     _mqttPublishHandler(topicStart, messageStart);
                 }
+
+                if (_mqttRouter) {
+                    mqtt_message_t msg;
+                    memset(&msg, 0, sizeof(msg));
+                    msg.topic = topicStart;
+                    msg.payload = reinterpret_cast<const uint8_t*>(messageStart);
+                    msg.size = strlen(messageStart);
+                    msg.length = msg.size;
+                    msg.last = true;
+
+                    _mqttRouter->dispatch(&msg);
+                }
             }
 
         }
@@ -1544,135 +1751,619 @@ uint16_t Sodaq_R4X::mqttReadMessages(char* buffer, size_t size, uint32_t timeout
     return messages;
 }
 
-bool Sodaq_R4X::mqttSetAuth(const char* name, const char* pw)
+/**
+ * Wait for the +UUMQTTCM URC of AT+UMQTTC=6
+ *
+ * The messages follow the URC directly, so the input is read one line at a
+ * time. poll() would discard the lines after the URC.
+ */
+void Sodaq_R4X::mqttWaitForPendingMessages(uint32_t startTime, uint32_t timeout)
 {
-    char buffer[16];
+    while ((_mqttPendingMessages == -1) && !is_timedout(startTime, timeout)) {
+        sodaq_wdt_reset();
 
-    print("AT+UMQTT=4,\"");
-    print(name);
-    print("\",\"");
-    print(pw);
-    println('"');
+        if (readLn(250) > 0) {
+            debugPrint("<< ");
+            debugPrintln(getInputBuffer());
 
-    return (readResponse(buffer, sizeof(buffer), "+UMQTT: ", _umqtt_timeout) == GSMResponseOK) && startsWith("4,1", buffer);
+            checkURC(getInputBuffer());
+        }
+    }
 }
 
-bool Sodaq_R4X::mqttSetCleanSession(bool enabled)
+/**
+ * Read the pending messages without copying them into a user buffer
+ *
+ * Each message is passed to the handler while it is read from the modem.
+ * With maxMessages == 0 all messages are dumped in one go (AT+UMQTTC=6),
+ * otherwise they are requested one by one (AT+UMQTTC=6,1), so that a large
+ * backlog can be spread over several calls.
+ */
+uint16_t Sodaq_R4X::mqttStreamMessages(MessageHandlerPtr handler, uint16_t maxMessages, uint32_t timeout)
 {
-    char buffer[16];
+    if (handler == NULL && _mqttRouter == NULL) {
+        return 0;
+    }
 
-    print("AT+UMQTT=12,");
-    println(enabled ? '1' : '0');
+    uint32_t startTime = millis();
+    uint16_t messages = 0;
 
-    return (readResponse(buffer, sizeof(buffer), "+UMQTT: ", _umqtt_timeout) == GSMResponseOK) && startsWith("12,1", buffer);
-}
+    do {
+        char bufferIn[16];
 
-bool Sodaq_R4X::mqttSetClientId(const char* id)
-{
-    char buffer[16];
+        _mqttPendingMessages = -1;
 
-    print("AT+UMQTT=0,\"");
-    print(id);
-    println('"');
+        println(maxMessages > 0 ? "AT+UMQTTC=6,1" : "AT+UMQTTC=6");
 
-    return (readResponse(buffer, sizeof(buffer), "+UMQTT: ", _umqtt_timeout) == GSMResponseOK) && startsWith("0,1", buffer);
-}
+        if ((readResponse(bufferIn, sizeof(bufferIn), "+UMQTTC: ", _umqtt_timeout) != GSMResponseOK) || !startsWith("6,1", bufferIn)) {
+            break;
+        }
 
-bool Sodaq_R4X::mqttSetInactivityTimeout(uint16_t timeout)
-{
-    char buffer[16];
+        mqttWaitForPendingMessages(startTime, timeout);
 
-    print("AT+UMQTT=10,");
-    println(timeout);
+        int16_t pending = _mqttPendingMessages;
+        if (pending <= 0) {
+            break;
+        }
 
-    return (readResponse(buffer, sizeof(buffer), "+UMQTT: ", _umqtt_timeout) == GSMResponseOK) && startsWith("10,1", buffer);
-}
+        // In single message mode the URC could still report the whole backlog
+        int16_t count = maxMessages > 0 ? 1 : pending;
+        int16_t read = 0;
 
-bool Sodaq_R4X::mqttSetLocalPort(uint16_t port)
-{
-    char buffer[16];
+        while (read < count && mqttStreamMessage(handler, startTime, timeout)) {
+            read++;
+        }
 
-    print("AT+UMQTT=1,");
-    println(port);
+        messages += read;
+        _mqttPendingMessages = pending - read;
 
-    return (readResponse(buffer, sizeof(buffer), "+UMQTT: ", _umqtt_timeout) == GSMResponseOK) && startsWith("1,1", buffer);
+        if (read < count) {
+            break;
+        }
+    } while (maxMessages > 0 && messages < maxMessages && !is_timedout(startTime, timeout));
+
+    return messages;
 }
 
-bool Sodaq_R4X::mqttSetSecureOption(bool enabled, int8_t profile)
+bool Sodaq_R4X::mqttSubscribeCommand(const char* filter, uint8_t qos)
 {
     char buffer[16];
 
-    print("AT+UMQTT=11,");
-    print(enabled ? '1' : '0');
-
-    if (profile >= 0) {
-        print(',');
-        println(profile);
-    }
+    print("AT+UMQTTC=4,");
+    print(qos);
+    print(",\"");
+    print(filter);
+    println('"');
 
-    return (readResponse(buffer, sizeof(buffer), "+UMQTT: ", _umqtt_timeout) == GSMResponseOK) && startsWith("11,1", buffer);
+    return (readResponse(buffer, sizeof(buffer), "+UMQTTC: ", _umqtt_timeout) == GSMResponseOK) && startsWith("4,1", buffer);
 }
 
-bool Sodaq_R4X::mqttSetServer(const char* server, uint16_t port)
+/**
+ * Reserve a slot to wait for the result of a subscription
+ *
+ * The slot of an asynchronous subscription is freed when its result arrives,
+ * otherwise the result is kept in the slot until the owner frees it.
+ * Returns the slot, or -1 if all are in use.
+ */
+int8_t Sodaq_R4X::mqttAddPendingSubscription(const char* filter, bool async)
 {
-    char buffer[16];
-
-    print("AT+UMQTT=2,\"");
-    print(server);
-
-    if (port > 0) {
-        print("\",");
-        println(port);
-    }
-    else {
-        println('"');
+    for (uint8_t i = 0; i < SODAQ_R4X_MAX_PENDING_SUBSCRIPTIONS; i++) {
+        if (_mqttSubscriptionResult[i] == MQTT_SUBSCRIPTION_FREE) {
+            _mqttSubscriptionHash[i] = fnv1a(FNV1A_INIT, filter, strlen(filter));
+            _mqttSubscriptionResult[i] = async ? MQTT_SUBSCRIPTION_ASYNC : MQTT_SUBSCRIPTION_PENDING;
+            return i;
+        }
     }
 
-  return (readResponse(buffer, sizeof(buffer), "+UMQTT: ", _umqtt_timeout) == GSMResponseOK) && startsWith("2,1", buffer);
+    return -1;
 }
 
-bool Sodaq_R4X::mqttSetServerIP(const char* ip, uint16_t port)
+/**
+ * Handle the +UUMQTTC: 4 result of a subscription
+ */
+void Sodaq_R4X::mqttSubscribeResult(const char* filter, int8_t result, uint8_t qos)
 {
-    char buffer[16];
+    uint32_t hash = fnv1a(FNV1A_INIT, filter, strlen(filter));
 
-    print("AT+UMQTT=3,\"");
-    print(ip);
+    for (uint8_t i = 0; i < SODAQ_R4X_MAX_PENDING_SUBSCRIPTIONS; i++) {
+        if (_mqttSubscriptionHash[i] != hash) {
+            continue;
+        }
 
-    if (port > 0) {
-        print("\",");
-        println(port);
-    }
-    else {
-        println('"');
+        if (_mqttSubscriptionResult[i] == MQTT_SUBSCRIPTION_PENDING) {
+            _mqttSubscriptionResult[i] = result;
+            break;
+        }
+
+        if (_mqttSubscriptionResult[i] == MQTT_SUBSCRIPTION_ASYNC) {
+            _mqttSubscriptionResult[i] = MQTT_SUBSCRIPTION_FREE;
+            break;
+        }
     }
 
-    return (readResponse(buffer, sizeof(buffer), "+UMQTT: ", _umqtt_timeout) == GSMResponseOK) && startsWith("3,1", buffer);
+    if (_mqttSubscribeHandler) {
+        _mqttSubscribeHandler(filter, result == 1, qos);
+    }
 }
 
-bool Sodaq_R4X::mqttSubscribe(const char* filter, uint8_t qos, uint32_t timeout)
+/**
+ * Read one message of a AT+UMQTTC=6 dump and pass it on to the handler
+ *
+ * A message is dumped like this
+ *     Topic:<topic>
+ *     Len:<length> QoS:<qos>       (not on all firmware versions)
+ *     Msg:<payload>
+ *
+ * The topic is kept at the start of the input buffer, the remainder of the
+ * input buffer is used to read the payload in chunks.
+ * If the length is known the payload is read as raw bytes, else up to the
+ * end of the line.
+ */
+bool Sodaq_R4X::mqttStreamMessage(MessageHandlerPtr handler, uint32_t startTime, uint32_t timeout)
 {
-    char buffer[16];
-
-    _mqttSubscribeReason = -1;
+    char* topic = getInputBuffer();
+    size_t topicSize = 0;
 
-    print("AT+UMQTTC=4,");
-    print(qos);
-    print(",\"");
-    print(filter);
-    println('"');
+    while (true) {
+        if (is_timedout(startTime, timeout)) {
+            return false;
+        }
 
-    uint32_t startTime = millis();
+        int count = readLn(250);
+        sodaq_wdt_reset();
 
-    if ((readResponse(buffer, sizeof(buffer), "+UMQTTC: ", _umqtt_timeout) != GSMResponseOK) || !startsWith("4,1", buffer)) {
-        return false;
+        if (count <= 0) {
+            continue;
+        }
+
+        debugPrint("<< ");
+        debugPrintln(topic);
+
+        if (startsWith("Topic:", topic)) {
+            topicSize = count - strlen("Topic:");
+            memmove(topic, topic + strlen("Topic:"), topicSize + 1);
+            break;
+        }
+
+        checkURC(topic);
+    }
+
+    // remove the extra CR/LF at the end
+    while (topicSize > 0 && (topic[topicSize - 1] == '\r' || topic[topicSize - 1] == '\n')) {
+        topic[--topicSize] = 0;
+    }
+
+    uint8_t* chunk = reinterpret_cast<uint8_t*>(topic + topicSize + 1);
+    size_t chunkSize = getInputBufferSize() - topicSize - 1;
+    if (chunkSize < 16) {
+        debugPrintln(DEBUG_STR_ERROR "MQTT topic too long for the input buffer!");
+        return false;
+    }
+
+    mqtt_message_t msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.topic = topic;
+    msg.payload = chunk;
+
+    char key[8];
+    char line[32];
+
+    // readBytesUntil() does not terminate a full buffer
+    size_t keyLength = readBytesUntil(':', key, sizeof(key) - 1);
+    key[keyLength] = 0;
+
+    if (startsWith("Len", key)) {
+        unsigned int length;
+        unsigned int qos;
+
+        readLn(line, sizeof(line));
+        if (sscanf(line, "%u QoS:%u", &length, &qos) == 2) {
+            msg.length = length;
+            msg.qos = qos;
+        }
+
+        keyLength = readBytesUntil(':', key, sizeof(key) - 1);
+        key[keyLength] = 0;
+    }
+
+    if (!startsWith("Msg", key)) {
+        debugPrintln(DEBUG_STR_ERROR "MQTT message is missing!");
+        return false;
+    }
+
+    if (msg.length > 0) {
+        while (msg.offset < msg.length) {
+            size_t size = readBytes(chunk, min(chunkSize, msg.length - msg.offset));
+            sodaq_wdt_reset();
+
+            if (size == 0) {
+                debugPrintln(DEBUG_STR_ERROR "MQTT message size error!");
+                return false;
+            }
+
+            msg.size = size;
+            msg.last = msg.offset + size == msg.length;
+            mqttDispatchMessage(handler, &msg);
+            msg.offset += size;
+        }
+
+        // skip the line terminator
+        readLn(line, sizeof(line), 250);
+
+        return true;
+    }
+
+    // Unknown length, read up to the end of the line
+    size_t carry = 0;
+    do {
+        size_t size = carry + readBytesUntil('\n', reinterpret_cast<char*>(chunk) + carry, chunkSize - carry);
+        sodaq_wdt_reset();
+
+        msg.last = size < chunkSize;
+        carry = 0;
+
+        if (msg.last) {
+            if (size > 0 && chunk[size - 1] == '\r') {
+                size--;
+            }
+        }
+        else if (chunk[size - 1] == '\r') {
+            // could be the start of the line terminator, keep it for the next chunk
+            carry = 1;
+            size--;
+        }
+
+        msg.size = size;
+        mqttDispatchMessage(handler, &msg);
+        msg.offset += size;
+
+        if (carry > 0) {
+            chunk[0] = '\r';
+        }
+    } while (!msg.last);
+
+    return true;
+}
+
+void Sodaq_R4X::mqttDispatchMessage(MessageHandlerPtr handler, const mqtt_message_t* msg)
+{
+    if (handler) {
+        handler(msg);
+    }
+    else if (_mqttRouter) {
+        _mqttRouter->dispatch(msg);
+    }
+}
+
+bool Sodaq_R4X::mqttApplyProfile(const mqtt_profile_t* profile)
+{
+    if (profile->clientId && !mqttSetClientId(profile->clientId)) {
+        return false;
+    }
+
+    if (profile->localPort && !mqttSetLocalPort(profile->localPort)) {
+        return false;
+    }
+
+    if (profile->server) {
+        if (!mqttSetServer(profile->server, profile->port)) {
+            return false;
+        }
+    }
+    else if (profile->serverIP) {
+        if (!mqttSetServerIP(profile->serverIP, profile->port)) {
+            return false;
+        }
+    }
+
+    if (profile->username && !mqttSetAuth(profile->username, profile->password ? profile->password : "")) {
+        return false;
+    }
+
+    if (profile->inactivityTimeout && !mqttSetInactivityTimeout(profile->inactivityTimeout)) {
+        return false;
+    }
+
+    return mqttSetSecureOption(profile->secure, profile->secureProfile) && mqttSetCleanSession(profile->cleanSession);
+}
+
+bool Sodaq_R4X::mqttNvm(uint8_t mode)
+{
+    char buffer[16];
+    char expected[4] = { (char)('0' + mode), ',', '1', 0 };
+
+    print("AT+UMQTTNV=");
+    println(mode);
+
+    return (readResponse(buffer, sizeof(buffer), "+UMQTTNV: ", _umqtt_timeout) == GSMResponseOK) && startsWith(expected, buffer);
+}
+
+bool Sodaq_R4X::mqttSetAuth(const char* name, const char* pw)
+{
+    char buffer[16];
+
+    print("AT+UMQTT=4,\"");
+    print(name);
+    print("\",\"");
+    print(pw);
+    println('"');
+
+    return (readResponse(buffer, sizeof(buffer), "+UMQTT: ", _umqtt_timeout) == GSMResponseOK) && startsWith("4,1", buffer);
+}
+
+bool Sodaq_R4X::mqttSetCleanSession(bool enabled)
+{
+    char buffer[16];
+
+    print("AT+UMQTT=12,");
+    println(enabled ? '1' : '0');
+
+    return (readResponse(buffer, sizeof(buffer), "+UMQTT: ", _umqtt_timeout) == GSMResponseOK) && startsWith("12,1", buffer);
+}
+
+bool Sodaq_R4X::mqttSetClientId(const char* id)
+{
+    char buffer[16];
+
+    print("AT+UMQTT=0,\"");
+    print(id);
+    println('"');
+
+    return (readResponse(buffer, sizeof(buffer), "+UMQTT: ", _umqtt_timeout) == GSMResponseOK) && startsWith("0,1", buffer);
+}
+
+bool Sodaq_R4X::mqttSetInactivityTimeout(uint16_t timeout)
+{
+    char buffer[16];
+
+    print("AT+UMQTT=10,");
+    println(timeout);
+
+    return (readResponse(buffer, sizeof(buffer), "+UMQTT: ", _umqtt_timeout) == GSMResponseOK) && startsWith("10,1", buffer);
+}
+
+bool Sodaq_R4X::mqttSetLocalPort(uint16_t port)
+{
+    char buffer[16];
+
+    print("AT+UMQTT=1,");
+    println(port);
+
+    return (readResponse(buffer, sizeof(buffer), "+UMQTT: ", _umqtt_timeout) == GSMResponseOK) && startsWith("1,1", buffer);
+}
+
+bool Sodaq_R4X::mqttSetSecureOption(bool enabled, int8_t profile)
+{
+    char buffer[16];
+
+    print("AT+UMQTT=11,");
+    print(enabled ? '1' : '0');
+
+    if (profile >= 0) {
+        print(',');
+        println(profile);
+    }
+    else {
+        println();
+    }
+
+    return (readResponse(buffer, sizeof(buffer), "+UMQTT: ", _umqtt_timeout) == GSMResponseOK) && startsWith("11,1", buffer);
+}
+
+bool Sodaq_R4X::mqttSetServer(const char* server, uint16_t port)
+{
+    char buffer[16];
+
+    print("AT+UMQTT=2,\"");
+    print(server);
+
+    if (port > 0) {
+        print("\",");
+        println(port);
+    }
+    else {
+        println('"');
+    }
+
+  return (readResponse(buffer, sizeof(buffer), "+UMQTT: ", _umqtt_timeout) == GSMResponseOK) && startsWith("2,1", buffer);
+}
+
+bool Sodaq_R4X::mqttSetServerIP(const char* ip, uint16_t port)
+{
+    char buffer[16];
+
+    print("AT+UMQTT=3,\"");
+    print(ip);
+
+    if (port > 0) {
+        print("\",");
+        println(port);
+    }
+    else {
+        println('"');
+    }
+
+    return (readResponse(buffer, sizeof(buffer), "+UMQTT: ", _umqtt_timeout) == GSMResponseOK) && startsWith("3,1", buffer);
+}
+
+/**
+ * The fingerprint of the settings of a profile
+ */
+static uint32_t mqtt_profile_fingerprint(const mqtt_profile_t* profile)
+{
+    uint32_t hash = FNV1A_INIT;
+
+    const char* strings[] = { profile->server, profile->serverIP, profile->clientId,
+                              profile->username, profile->password };
+    for (size_t i = 0; i < DIM(strings); i++) {
+        // Include the terminator, to tell "ab","c" from "a","bc", and NULL from ""
+        hash = strings[i] ? fnv1a(hash, strings[i], strlen(strings[i]) + 1) : fnv1a(hash, "\xFF", 1);
+    }
+
+    const uint16_t numbers[] = { profile->port, profile->localPort, profile->inactivityTimeout,
+                                 profile->cleanSession, profile->secure, (uint16_t)profile->secureProfile };
+
+    return fnv1a(hash, numbers, sizeof(numbers));
+}
+
+bool Sodaq_R4X::mqttSetProfile(const mqtt_profile_t* profile)
+{
+    uint32_t fingerprint = mqtt_profile_fingerprint(profile);
+    uint32_t filesize = 0;
+    uint8_t stored[4];
+
+    // Check the file first, readFilePartial() does not handle a missing file
+    if (getFileSize(SODAQ_R4X_MQTT_PROFILE_FILENAME, filesize) && (filesize == sizeof(stored)) &&
+            (readFilePartial(SODAQ_R4X_MQTT_PROFILE_FILENAME, stored, sizeof(stored), 0) == sizeof(stored)) &&
+            (get_le32(stored) == fingerprint) &&
+            mqttRestoreProfile()) {
+        return true;
+    }
+
+    // Remove the old fingerprint first, it is no longer valid if this fails halfway
+    deleteFile(SODAQ_R4X_MQTT_PROFILE_FILENAME);
+
+    if (!mqttApplyProfile(profile) || !mqttSaveProfile()) {
+        return false;
+    }
+
+    put_le32(stored, fingerprint);
+
+    // The profile is applied, a missing fingerprint only costs a full setup next time
+    if (!writeFile(SODAQ_R4X_MQTT_PROFILE_FILENAME, stored, sizeof(stored))) {
+        debugPrintln(DEBUG_STR_ERROR "Could not store the MQTT profile fingerprint");
+    }
+
+    return true;
+}
+
+bool Sodaq_R4X::mqttRestoreProfile()
+{
+    return mqttNvm(1);
+}
+
+bool Sodaq_R4X::mqttSaveProfile()
+{
+    return mqttNvm(2);
+}
+
+bool Sodaq_R4X::mqttSubscribe(const char* filter, uint8_t qos, uint32_t timeout)
+{
+    _mqttSubscribeReason = -1;
+
+    uint32_t startTime = millis();
+
+    if (!mqttSubscribeCommand(filter, qos)) {
+        return false;
+    }
+
+    // check URC synchronously
+    while ((_mqttSubscribeReason == -1) && !is_timedout(startTime, timeout)) {
+        mqttLoop();
+    }
+
+    return (_mqttSubscribeReason == 1);
+}
+
+/**
+ * Subscribe to several filters with one network round trip
+ *
+ * The subscriptions are sent without waiting for the results in between.
+ * If there are more than SODAQ_R4X_MAX_PENDING_SUBSCRIPTIONS, the rest is
+ * sent when results come in.
+ */
+uint8_t Sodaq_R4X::mqttSubscribeMany(const char* const* filters, const uint8_t* qos, uint8_t count, uint32_t timeout)
+{
+    uint32_t startTime = millis();
+    bool     owned[SODAQ_R4X_MAX_PENDING_SUBSCRIPTIONS] = { false };
+    uint8_t  pending = 0;
+    uint8_t  issued = 0;
+    uint8_t  succeeded = 0;
+
+    while ((issued < count || pending > 0) && !is_timedout(startTime, timeout)) {
+        while (issued < count) {
+            int8_t slot = mqttAddPendingSubscription(filters[issued], false);
+            if (slot < 0) {
+                break;
+            }
+
+            if (mqttSubscribeCommand(filters[issued], qos ? qos[issued] : 0)) {
+                owned[slot] = true;
+                pending++;
+            }
+            else {
+                _mqttSubscriptionResult[slot] = MQTT_SUBSCRIPTION_FREE;
+            }
+
+            issued++;
+        }
+
+        mqttLoop();
+
+        for (uint8_t i = 0; i < SODAQ_R4X_MAX_PENDING_SUBSCRIPTIONS; i++) {
+            if (owned[i] && _mqttSubscriptionResult[i] != MQTT_SUBSCRIPTION_PENDING) {
+                if (_mqttSubscriptionResult[i] == 1) {
+                    succeeded++;
+                }
+
+                _mqttSubscriptionResult[i] = MQTT_SUBSCRIPTION_FREE;
+                owned[i] = false;
+                pending--;
+            }
+        }
+    }
+
+    // Forget the ones that timed out
+    for (uint8_t i = 0; i < SODAQ_R4X_MAX_PENDING_SUBSCRIPTIONS; i++) {
+        if (owned[i]) {
+            _mqttSubscriptionResult[i] = MQTT_SUBSCRIPTION_FREE;
+        }
+    }
+
+    return succeeded;
+}
+
+bool Sodaq_R4X::mqttSubscribeAsync(const char* filter, uint8_t qos)
+{
+    int8_t slot = mqttAddPendingSubscription(filter, true);
+    if (slot < 0) {
+        debugPrintln(DEBUG_STR_ERROR "Too many pending subscriptions");
+        return false;
     }
 
-    // check URC synchronously
-    while ((_mqttSubscribeReason == -1) && !is_timedout(startTime, timeout)) {
-        mqttLoop();
+    if (!mqttSubscribeCommand(filter, qos)) {
+        _mqttSubscriptionResult[slot] = MQTT_SUBSCRIPTION_FREE;
+        return false;
     }
 
-    return (_mqttSubscribeReason == 1);
+    return true;
+}
+
+uint8_t Sodaq_R4X::mqttGetPendingSubscriptions()
+{
+    uint8_t count = 0;
+
+    for (uint8_t i = 0; i < SODAQ_R4X_MAX_PENDING_SUBSCRIPTIONS; i++) {
+        if (_mqttSubscriptionResult[i] == MQTT_SUBSCRIPTION_PENDING ||
+                _mqttSubscriptionResult[i] == MQTT_SUBSCRIPTION_ASYNC) {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+uint8_t Sodaq_R4X::mqttUnsubscribeMany(const char* const* filters, uint8_t count)
+{
+    uint8_t accepted = 0;
+
+    for (uint8_t i = 0; i < count; i++) {
+        if (mqttUnsubscribe(filters[i])) {
+            accepted++;
+        }
+    }
+
+    return accepted;
 }
 
 bool Sodaq_R4X::mqttUnsubscribe(const char* filter)
@@ -1750,32 +2441,24 @@ uint32_t Sodaq_R4X::httpGetHeaderSize(const char* filename)
         return 0;
     }
 
-    int state = 0; // 0 nothing, 1=CR, 2=CRLF, 3=CRLFCR, 4=CRLFCRLF
+    uint8_t state = 0;
     uint8_t buffer[64];
     uint32_t offset = 0;
 
+    httpResetResponse();
+
     while (offset < file_size && state != 4) {
         size_t size;
-        size = readFilePartial(filename, buffer, sizeof(buffer), offset);
+        size = readFilePartial(filename, buffer, min((uint32_t)sizeof(buffer), file_size - offset), offset);
 
         if (size == 0) {
             return 0;
         }
 
-        size_t ix;
-        for (ix = 0; state != 4 && ix < sizeof(buffer); ix++) {
-            if ((state == 0 || state == 2) && buffer[ix] == '\r') {
-                state++;
-            }
-            else if ((state == 1 || state == 3) && buffer[ix] == '\n') {
-                state++;
-            }
-            else {
-                state = 0;
-            }
-        }
+        size_t ix = httpScanHeader(buffer, size, state);
 
         if (state == 4) {
+            _httpResponse.headerSize = offset + ix;
             return offset + ix;
         }
 
@@ -1799,6 +2482,106 @@ size_t Sodaq_R4X::httpGetPartial(uint8_t* buffer, size_t size, uint32_t offset)
     return readFilePartial(HTTP_RECEIVE_FILENAME, buffer, size, _httpGetHeaderSize + offset);
 }
 
+uint32_t Sodaq_R4X::httpGetStream(const char* server, uint16_t port, const char* endpoint,
+                                  HttpBodyHandlerPtr handler, uint8_t* buffer, size_t bufferSize,
+                                  uint32_t timeout, bool useURC)
+{
+    _httpAcceptEncoding = true;
+    size_t file_size = httpRequest(server, port, endpoint, GET, NULL, 0, NULL, 0, timeout, useURC);
+    _httpAcceptEncoding = false;
+
+    if (file_size == 0) {
+        return 0;
+    }
+
+    return httpStreamResponse(handler, buffer, bufferSize);
+}
+
+/**
+ * Pass the body of the last HTTP response to the handler
+ *
+ * The response file is read only once, in blocks of the buffer size. The end
+ * of the header is found in the same blocks as the start of the body, which
+ * saves the separate header scan of httpGetHeaderSize().
+ * An encoded body goes through the inflater, which passes the decoded data
+ * to the handler.
+ */
+uint32_t Sodaq_R4X::httpStreamResponse(HttpBodyHandlerPtr handler, uint8_t* buffer, size_t bufferSize)
+{
+    uint32_t file_size;
+
+    if (!buffer || bufferSize == 0 || !getFileSize(HTTP_RECEIVE_FILENAME, file_size)) {
+        return 0;
+    }
+
+    uint8_t state = 0;
+    uint32_t offset = 0;
+    uint32_t bodyOffset = 0;
+    bool encoded = false;
+
+    _httpGetHeaderSize = 0;
+    httpResetResponse();
+
+    while (offset < file_size) {
+        sodaq_wdt_reset();
+
+        size_t size = readFilePartial(HTTP_RECEIVE_FILENAME, buffer, min((uint32_t)bufferSize, file_size - offset), offset);
+        if (size == 0) {
+            debugPrintln(DEBUG_STR_ERROR "Could not read the http response!");
+            return 0;
+        }
+
+        size_t ix = 0;
+        if (state != 4) {
+            ix = httpScanHeader(buffer, size, state);
+
+            if (state == 4) {
+                _httpGetHeaderSize = offset + ix;
+                _httpResponse.headerSize = _httpGetHeaderSize;
+
+                const char* encoding = _httpResponse.contentEncoding;
+                encoded = _httpInflater && (strncasecmp(encoding, "gzip", 4) == 0 || strncasecmp(encoding, "deflate", 7) == 0);
+
+                if (encoded) {
+                    _httpInflater->setSink(handler);
+                    _httpInflater->begin(InflateAuto);
+                }
+            }
+        }
+
+        if (state == 4 && ix < size) {
+            if (encoded) {
+                if (!_httpInflater->write(&buffer[ix], size - ix)) {
+                    debugPrintln(DEBUG_STR_ERROR "Could not decode the http response!");
+                    return 0;
+                }
+            }
+            else if (handler) {
+                handler(&buffer[ix], size - ix, bodyOffset);
+            }
+            bodyOffset += size - ix;
+        }
+
+        offset += size;
+    }
+
+    if (state != 4) {
+        // Don't trust a file without HTTP response header
+        return 0;
+    }
+
+    if (encoded) {
+        if (!_httpInflater->isDone()) {
+            debugPrintln(DEBUG_STR_ERROR "The encoded http response is incomplete!");
+            return 0;
+        }
+
+        return _httpInflater->getOutputSize();
+    }
+
+    return bodyOffset;
+}
+
 // Creates an HTTP POST request and optionally returns the received data.
 // Note. Endpoint should include the initial "/".
 // The UBlox device stores the received data in http_last_response_<profile_id>
@@ -1806,6 +2589,17 @@ uint32_t Sodaq_R4X::httpPost(const char* server, uint16_t port, const char* endp
                              char* responseBuffer, size_t responseSize,
                              const char* sendBuffer, size_t sendSize, uint32_t timeout, bool useURC)
 {
+    if (sendBuffer && sendSize > 0 &&
+            http_escaped_size((const uint8_t*)sendBuffer, sendSize) <= SODAQ_R4X_HTTP_INLINE_POST_SIZE) {
+        // httpRequest() sends the body in the command
+        uint32_t file_size = httpRequest(server, port, endpoint, POST, NULL, 0, sendBuffer, sendSize, timeout, useURC);
+        if (file_size == 0) {
+            return 0;
+        }
+
+        return httpPostResponse(file_size, responseBuffer, responseSize);
+    }
+
     deleteFile(HTTP_SEND_TMP_FILENAME); // cleanup the file first (if exists)
 
     if (!writeFile(HTTP_SEND_TMP_FILENAME, (uint8_t*)sendBuffer, sendSize)) {
@@ -1831,6 +2625,13 @@ uint32_t Sodaq_R4X::httpPostFromFile(const char* server, uint16_t port, const ch
         return 0;
     }
 
+    return httpPostResponse(file_size, responseBuffer, responseSize);
+}
+
+// Returns the size of the body of the POST response in the file of the given size,
+// or copies the start of the body into the buffer and returns the number of bytes.
+uint32_t Sodaq_R4X::httpPostResponse(uint32_t fileSize, char* responseBuffer, size_t responseSize)
+{
     // Find out the header size
     _httpGetHeaderSize = httpGetHeaderSize(HTTP_RECEIVE_FILENAME);
 
@@ -1842,7 +2643,7 @@ uint32_t Sodaq_R4X::httpPostFromFile(const char* server, uint16_t port, const ch
     }
 
     if (!responseBuffer) {
-        return file_size - _httpGetHeaderSize;
+        return fileSize - _httpGetHeaderSize;
     }
 
     // Fill the buffer starting from the header
@@ -1856,6 +2657,8 @@ size_t Sodaq_R4X::httpRequest(const char* server, uint16_t port, const char* end
                               char* responseBuffer, size_t responseSize,
                               const char* sendBuffer, size_t sendSize, uint32_t timeout, bool useURC)
 {
+    bool inlineBody = false;
+
     // before starting the actual http request, create any files needed in the fs of the modem
     // that way there is a chance to abort sending the http req command in case of an fs error
     if (requestType == PUT || requestType == POST) {
@@ -1864,6 +2667,12 @@ size_t Sodaq_R4X::httpRequest(const char* server, uint16_t port, const char* end
             return 0;
         }
 
+        // a small POST body is sent in the command itself
+        inlineBody = (requestType == POST) &&
+                     (http_escaped_size((const uint8_t*)sendBuffer, sendSize) <= SODAQ_R4X_HTTP_INLINE_POST_SIZE);
+    }
+
+    if ((requestType == PUT || requestType == POST) && !inlineBody) {
         deleteFile(HTTP_SEND_TMP_FILENAME); // cleanup the file first (if exists)
 
         if (!writeFile(HTTP_SEND_TMP_FILENAME, (uint8_t*)sendBuffer, sendSize)) {
@@ -1875,75 +2684,81 @@ size_t Sodaq_R4X::httpRequest(const char* server, uint16_t port, const char* end
                                    HTTP_SEND_TMP_FILENAME, timeout, useURC);
     }
 
-    // reset http profile 0
-    println("AT+UHTTP=0");
-    if (readResponse() != GSMResponseOK) {
+    if (requestType >= HttpRequestTypesMAX) {
+        debugPrintln(DEBUG_STR_ERROR "Unknown request type!");
         return 0;
     }
 
-    deleteFile(HTTP_RECEIVE_FILENAME); // cleanup the file first (if exists)
+    // reset the success bit before calling a new request
+    _httpRequestSuccessBit[requestType] = TriBoolUndefined;
 
-    if (requestType >= HttpRequestTypesMAX) {
-        debugPrintln(DEBUG_STR_ERROR "Unknown request type!");
+    // forget the header of the previous response
+    _httpGetHeaderSize = 0;
+    httpResetResponse();
+
+    if (!httpSendRequest(0, server, port, endpoint, requestType, NULL,
+                         (const uint8_t*)(inlineBody ? sendBuffer : NULL), sendSize)) {
         return 0;
     }
 
-    // set server host name
-    print("AT+UHTTP=0,");
-    print(isValidIPv4(server) ? "0,\"" : "1,\"");
-    print(server);
-    println("\"");
-    if (readResponse() != GSMResponseOK) {
+    return httpWaitForResponse(requestType, responseBuffer, responseSize, timeout, useURC);
+}
+
+// Creates an HTTP request using the (optional) given buffer and
+// (optionally) returns the received data.
+// endpoint should include the initial "/".
+// Request body must first be prepared in a file on the modem
+size_t Sodaq_R4X::httpRequestFromFile(const char* server, uint16_t port, const char* endpoint, HttpRequestTypes requestType,
+                                      char* responseBuffer, size_t responseSize,
+                                      const char* fileName, uint32_t timeout, bool useURC)
+{
+    if (requestType != PUT && requestType != POST) {
         return 0;
     }
 
-    // set port
-    if (port != 80) {
-        print("AT+UHTTP=0,5,");
-        println(port);
-
-        if (readResponse() != GSMResponseOK) {
-            return 0;
-        }
+    if (requestType >= HttpRequestTypesMAX) {
+        debugPrintln(DEBUG_STR_ERROR "Unknown request type!");
+        return 0;
     }
 
     // reset the success bit before calling a new request
     _httpRequestSuccessBit[requestType] = TriBoolUndefined;
 
-    print("AT+UHTTPC=0,");
-    print(requestType < sizeof(httpRequestMapping) ? httpRequestMapping[requestType] : 1);
-    print(",\"");
-    print(endpoint);
-    println("\",\"\""); // empty filename = default = "http_last_response_0" (DEFAULT_HTTP_RECEIVE_FILENAME)
+    // forget the header of the previous response
+    _httpGetHeaderSize = 0;
+    httpResetResponse();
 
-    if (readResponse() != GSMResponseOK) {
+    if (!httpSendRequest(0, server, port, endpoint, requestType, fileName)) {
         return 0;
     }
 
-    // check for success while checking URCs
-    // This loop relies on readResponse being called via isAlive()
-    uint32_t start = millis();
-    uint32_t delay_count = 50;
-    while ((_httpRequestSuccessBit[requestType] == TriBoolUndefined) && !is_timedout(start, timeout)) {
-        if (useURC) {
-            isAlive();
-            if (_httpRequestSuccessBit[requestType] != TriBoolUndefined) {
-                break;
-            }
-        }
-        else {
+    return httpWaitForResponse(requestType, responseBuffer, responseSize, timeout, useURC);
+}
+
+// Waits for the result of the request that was sent on profile 0, and returns the
+// response like httpRequest() does.
+size_t Sodaq_R4X::httpWaitForResponse(HttpRequestTypes requestType, char* responseBuffer, size_t responseSize,
+                                      uint32_t timeout, bool useURC)
+{
+    if (useURC) {
+        httpWaitForUrc(_httpRequestSuccessBit[requestType], timeout);
+    }
+    else {
+        uint32_t start = millis();
+        uint32_t delay_count = 50;
+        while ((_httpRequestSuccessBit[requestType] == TriBoolUndefined) && !is_timedout(start, timeout)) {
             uint32_t size;
             getFileSize(HTTP_RECEIVE_FILENAME, size);
             println("AT+UHTTPER=0");
             if (readResponse(NULL, 100) == GSMResponseOK) {
                 break;
             }
-        }
 
-        sodaq_wdt_safe_delay(delay_count);
-        // Next time wait a little longer, but not longer than 5 seconds
-        if (delay_count < 5000) {
-            delay_count += 250;
+            sodaq_wdt_safe_delay(delay_count);
+            // Next time wait a little longer, but not longer than 5 seconds
+            if (delay_count < 5000) {
+                delay_count += 250;
+            }
         }
     }
 
@@ -1961,136 +2776,480 @@ size_t Sodaq_R4X::httpRequest(const char* server, uint16_t port, const char* end
             return file_size;
         }
     }
-    else if (_httpRequestSuccessBit[requestType] == TriBoolFalse) {
-        debugPrintln(DEBUG_STR_ERROR "An error occurred with the http request!");
+    else if (_httpRequestSuccessBit[requestType] == TriBoolFalse) {
+        debugPrintln(DEBUG_STR_ERROR "An error occurred with the http request!");
+        return 0;
+    }
+    else {
+        debugPrintln(DEBUG_STR_ERROR "Timed out waiting for a response for the http request!");
+        return 0;
+    }
+
+    return 0;
+}
+
+// Creates an HTTP PUT or POST request with a body that is produced by the generator.
+// endpoint should include the initial "/".
+size_t Sodaq_R4X::httpUpload(const char* server, uint16_t port, const char* endpoint, HttpRequestTypes requestType,
+                             HttpBodyGeneratorPtr generator, uint8_t* buffer, size_t bufferSize,
+                             WriteProgressHandlerPtr progress, uint32_t timeout, bool useURC)
+{
+    if (requestType != PUT && requestType != POST) {
+        return 0;
+    }
+
+    if (!generator || !buffer || bufferSize == 0) {
+        debugPrintln(DEBUG_STR_ERROR "There is no generator or buffer set!");
+        return 0;
+    }
+
+    deleteFile(HTTP_SEND_TMP_FILENAME); // cleanup the file first (if exists)
+
+    // writeFile() appends to the existing file
+    uint32_t offset = 0;
+    size_t size;
+    while ((size = generator(buffer, bufferSize, offset)) > 0) {
+        if (size > bufferSize || !writeFile(HTTP_SEND_TMP_FILENAME, buffer, size)) {
+            debugPrintln(DEBUG_STR_ERROR "Could not write the http tmp file!");
+            return 0;
+        }
+
+        offset += size;
+
+        if (progress) {
+            progress(offset);
+        }
+    }
+
+    if (offset == 0) {
+        debugPrintln(DEBUG_STR_ERROR "The generator did not produce a body!");
+        return 0;
+    }
+
+    return httpRequestFromFile(server, port, endpoint, requestType, NULL, 0, HTTP_SEND_TMP_FILENAME, timeout, useURC);
+}
+
+// Configures http profile 0 for the server, the blocking requests to the same
+// server then keep the custom headers that are set afterwards.
+bool Sodaq_R4X::httpSetServer(const char* server, uint16_t port)
+{
+    return httpSetProfile(0, server, port);
+}
+
+// Creates an HTTP GET request and stores the response, including the header, in the file.
+// Returns the size of the file, or 0 if the request failed.
+uint32_t Sodaq_R4X::httpGetToFile(const char* server, uint16_t port, const char* endpoint,
+                                  const char* fileName, uint32_t timeout)
+{
+    // reset the success bit before calling a new request
+    _httpRequestSuccessBit[GET] = TriBoolUndefined;
+
+    if (!httpSendRequest(0, server, port, endpoint, GET, NULL, NULL, 0, fileName)) {
+        return 0;
+    }
+
+    httpWaitForUrc(_httpRequestSuccessBit[GET], timeout);
+
+    if (_httpRequestSuccessBit[GET] != TriBoolTrue) {
+        debugPrintln(DEBUG_STR_ERROR "The http request failed or timed out!");
+        return 0;
+    }
+
+    uint32_t file_size;
+    if (!getFileSize(fileName, file_size)) {
+        debugPrintln(DEBUG_STR_ERROR "Could not determine file size");
+        return 0;
+    }
+
+    return file_size;
+}
+
+// Starts an HTTP request on a free profile and returns without waiting for the response.
+// endpoint should include the initial "/".
+// Returns the profile, or -1 if there is no free profile or the request could not be sent.
+int8_t Sodaq_R4X::httpRequestAsync(const char* server, uint16_t port, const char* endpoint,
+                                   HttpRequestTypes requestType, const char* sendBuffer, size_t sendSize)
+{
+    if (requestType >= HttpRequestTypesMAX) {
+        debugPrintln(DEBUG_STR_ERROR "Unknown request type!");
+        return -1;
+    }
+
+    // profile 0 is used by the blocking requests
+    int8_t profile = -1;
+    for (uint8_t i = 1; i < SODAQ_R4X_HTTP_PROFILE_COUNT; i++) {
+        if (!_httpProfileBusy[i]) {
+            profile = i;
+            break;
+        }
+    }
+
+    if (profile < 0) {
+        debugPrintln(DEBUG_STR_ERROR "There is no free http profile!");
+        return -1;
+    }
+
+    char fileName[HTTP_FILENAME_SIZE];
+    bool inlineBody = false;
+
+    if (requestType == PUT || requestType == POST) {
+        if (!sendBuffer || sendSize == 0) {
+            debugPrintln(DEBUG_STR_ERROR "There is no sendBuffer or sendSize set!");
+            return -1;
+        }
+
+        // a small POST body is sent in the command itself
+        inlineBody = (requestType == POST) &&
+                     (http_escaped_size((const uint8_t*)sendBuffer, sendSize) <= SODAQ_R4X_HTTP_INLINE_POST_SIZE);
+    }
+
+    if ((requestType == PUT || requestType == POST) && !inlineBody) {
+        http_profile_filename(fileName, HTTP_SEND_TMP_FILENAME_PREFIX, profile);
+        deleteFile(fileName); // cleanup the file first (if exists)
+
+        if (!writeFile(fileName, (uint8_t*)sendBuffer, sendSize)) {
+            debugPrintln(DEBUG_STR_ERROR "Could not create the http tmp file!");
+            return -1;
+        }
+    }
+
+    _httpProfileResult[profile] = TriBoolUndefined;
+    _httpProfileHeaderSize[profile] = 0;
+
+    bool hasFile = (requestType == PUT || requestType == POST) && !inlineBody;
+
+    if (!httpSendRequest(profile, server, port, endpoint, requestType, hasFile ? fileName : NULL,
+                         (const uint8_t*)(inlineBody ? sendBuffer : NULL), sendSize)) {
+        return -1;
+    }
+
+    _httpProfileBusy[profile] = true;
+
+    return profile;
+}
+
+tribool_t Sodaq_R4X::httpGetRequestResult(int8_t profile)
+{
+    if (profile <= 0 || profile >= SODAQ_R4X_HTTP_PROFILE_COUNT || !_httpProfileBusy[profile]) {
+        return TriBoolFalse;
+    }
+
+    return _httpProfileResult[profile];
+}
+
+// Waits until the request of the profile has completed, returns true if it succeeded.
+bool Sodaq_R4X::httpWaitForRequest(int8_t profile, uint32_t timeout)
+{
+    if (httpGetRequestResult(profile) == TriBoolUndefined) {
+        httpWaitForUrc(_httpProfileResult[profile], timeout);
+    }
+
+    return (httpGetRequestResult(profile) == TriBoolTrue);
+}
+
+/**
+ * Wait for the +UUHTTPCR URC that sets the result
+ *
+ * The input is read as it comes in with poll(), no commands are sent
+ * to the modem. The result is handled as soon as the line is complete.
+ */
+void Sodaq_R4X::httpWaitForUrc(const tribool_t& result, uint32_t timeout)
+{
+    uint32_t start = millis();
+
+    while ((result == TriBoolUndefined) && !is_timedout(start, timeout)) {
+        if (poll() == 0) {
+            sodaq_wdt_safe_delay(HTTP_URC_POLL_INTERVAL);
+        }
+    }
+}
+
+// Reads the body of the response of the profile, offset 0 is the byte directly after the header.
+size_t Sodaq_R4X::httpReadResponse(int8_t profile, uint8_t* buffer, size_t size, uint32_t offset)
+{
+    if (httpGetRequestResult(profile) != TriBoolTrue) {
         return 0;
     }
-    else {
-        debugPrintln(DEBUG_STR_ERROR "Timed out waiting for a response for the http request!");
+
+    char fileName[HTTP_FILENAME_SIZE];
+    http_profile_filename(fileName, HTTP_RECEIVE_FILENAME_PREFIX, profile);
+
+    if (_httpProfileHeaderSize[profile] == 0) {
+        _httpProfileHeaderSize[profile] = httpGetHeaderSize(fileName);
+    }
+
+    if (_httpProfileHeaderSize[profile] == 0) {
+        debugPrintln(DEBUG_STR_ERROR "Could not determine the http header size");
         return 0;
     }
 
-    return 0;
+    return readFilePartial(fileName, buffer, size, _httpProfileHeaderSize[profile] + offset);
 }
 
-// Creates an HTTP request using the (optional) given buffer and
-// (optionally) returns the received data.
-// endpoint should include the initial "/".
-// Request body must first be prepared in a file on the modem
-size_t Sodaq_R4X::httpRequestFromFile(const char* server, uint16_t port, const char* endpoint, HttpRequestTypes requestType,
-                                      char* responseBuffer, size_t responseSize,
-                                      const char* fileName, uint32_t timeout, bool useURC)
+void Sodaq_R4X::httpReleaseProfile(int8_t profile)
 {
-    if (requestType != PUT && requestType != POST) {
-        return 0;
+    if (profile > 0 && profile < SODAQ_R4X_HTTP_PROFILE_COUNT) {
+        _httpProfileBusy[profile] = false;
     }
+}
 
-    // reset http profile 0
-    println("AT+UHTTP=0");
-    if (readResponse() != GSMResponseOK) {
-        return 0;
+/**
+ * Configure the http profile for the given server
+ *
+ * The settings of the profile are remembered, so nothing is sent when
+ * they did not change since the previous request. Changing the server
+ * resets the profile, which also clears the custom headers.
+ */
+bool Sodaq_R4X::httpSetProfile(uint8_t profile, const char* server, uint16_t port)
+{
+    uint32_t hash = fnv1a(FNV1A_INIT, server, strlen(server) + 1);
+    hash = fnv1a(hash, &port, sizeof(port));
+
+    if (hash == _httpProfileHash[profile]) {
+        return true;
     }
 
-    deleteFile(HTTP_RECEIVE_FILENAME); // cleanup the file first (if exists)
+    _httpProfileHash[profile] = 0;
 
-    if (requestType >= HttpRequestTypesMAX) {
-        debugPrintln(DEBUG_STR_ERROR "Unknown request type!");
-        return 0;
+    // reset the http profile
+    print("AT+UHTTP=");
+    println(profile);
+    if (readResponse() != GSMResponseOK) {
+        return false;
+    }
+
+    // the reset cleared the custom headers
+    if (profile == 0) {
+        memset(_httpHeaderHash, 0, sizeof(_httpHeaderHash));
     }
 
     // set server host name
-    print("AT+UHTTP=0,");
-    print(isValidIPv4(server) ? "0,\"" : "1,\"");
+    print("AT+UHTTP=");
+    print(profile);
+    print(isValidIPv4(server) ? ",0,\"" : ",1,\"");
     print(server);
     println("\"");
     if (readResponse() != GSMResponseOK) {
-        return 0;
+        return false;
     }
 
     // set port
     if (port != 80) {
-        print("AT+UHTTP=0,5,");
+        print("AT+UHTTP=");
+        print(profile);
+        print(",5,");
         println(port);
 
         if (readResponse() != GSMResponseOK) {
-            return 0;
+            return false;
         }
     }
 
-    // reset the success bit before calling a new request
-    _httpRequestSuccessBit[requestType] = TriBoolUndefined;
+    _httpProfileHash[profile] = hash;
 
-    print("AT+UHTTPC=0,");
-    print(requestType < sizeof(httpRequestMapping) ? httpRequestMapping[requestType] : 1);
-    print(",\"");
-    print(endpoint);
-    print("\",\"\",\"");
-    print(fileName);
-    println(requestType == POST ? "\",1" : "\"\n");
+    return true;
+}
 
-    if (readResponse() != GSMResponseOK) {
-        return 0;
+// Sends the AT+UHTTPC command, the response is stored in http_last_response_<profile>,
+// or in responseFileName if that is set.
+// fileName is the file with the request body, or NULL.
+// data is a POST body that is sent in the command (POST data), or NULL.
+bool Sodaq_R4X::httpSendRequest(uint8_t profile, const char* server, uint16_t port, const char* endpoint,
+                                HttpRequestTypes requestType, const char* fileName,
+                                const uint8_t* data, size_t dataSize, const char* responseFileName)
+{
+    if (!httpSetProfile(profile, server, port)) {
+        return false;
     }
 
-    // check for success while checking URCs
-    // This loop relies on readResponse being called via isAlive()
-    uint32_t start = millis();
-    uint32_t delay_count = 50;
-    while ((_httpRequestSuccessBit[requestType] == TriBoolUndefined) && !is_timedout(start, timeout)) {
-        if (useURC) {
-            isAlive();
-            if (_httpRequestSuccessBit[requestType] != TriBoolUndefined) {
-                break;
+    if (profile == 0 && _httpHeaders && !httpApplyHeaders(*_httpHeaders)) {
+        return false;
+    }
+
+    // Only httpGetStream() decodes a compressed response, the slot is only
+    // cleared again if it still holds the header that was set here
+    if (profile == 0) {
+        uint8_t slot = SODAQ_R4X_HTTP_INFLATE_HEADER_SLOT;
+
+        if (_httpAcceptEncoding && _httpInflater) {
+            if (!httpSetCustomHeader(slot, HTTP_ACCEPT_ENCODING_NAME, HTTP_ACCEPT_ENCODING_VALUE)) {
+                return false;
             }
         }
-        else {
-            uint32_t size;
-            getFileSize(HTTP_RECEIVE_FILENAME, size);
-            println("AT+UHTTPER=0");
-            if (readResponse(NULL, 100) == GSMResponseOK) {
-                break;
-            }
+        else if (_httpHeaderHash[slot] == http_header_hash(HTTP_ACCEPT_ENCODING_NAME, HTTP_ACCEPT_ENCODING_VALUE) &&
+                 !httpClearCustomHeader(slot)) {
+            return false;
         }
+    }
 
-        sodaq_wdt_safe_delay(delay_count);
-        // Next time wait a little longer, but not longer than 5 seconds
-        if (delay_count < 5000) {
-            delay_count += 250;
-        }
+    char profileFileName[HTTP_FILENAME_SIZE];
+    if (!responseFileName) {
+        http_profile_filename(profileFileName, HTTP_RECEIVE_FILENAME_PREFIX, profile);
+        responseFileName = profileFileName;
     }
 
-    if (_httpRequestSuccessBit[requestType] == TriBoolTrue) {
-        uint32_t file_size;
-        if (!getFileSize(HTTP_RECEIVE_FILENAME, file_size)) {
-            debugPrintln(DEBUG_STR_ERROR "Could not determine file size");
-            return 0;
+    print("AT+UHTTPC=");
+    print(profile);
+    print(',');
+    if (data) {
+        print(HTTP_POST_DATA_COMMAND);
+    }
+    else {
+        print(requestType < sizeof(httpRequestMapping) ? httpRequestMapping[requestType] : 1);
+    }
+    print(",\"");
+    print(endpoint);
+    print("\",\"");
+    print(responseFileName);
+
+    if (data) {
+        print("\",\"");
+        httpPrintEscaped(data, dataSize);
+        print("\",");
+        println(_httpContentType);
+    }
+    else if (fileName) {
+        print("\",\"");
+        print(fileName);
+        if (requestType == POST) {
+            print("\",");
+            println(_httpContentType);
         }
-        if (responseBuffer && responseSize > 0 && file_size < responseSize) {
-            return readFile(HTTP_RECEIVE_FILENAME, (uint8_t*)responseBuffer, responseSize);
+        else {
+            println('"');
+        }
+    }
+    else {
+        println('"');
+    }
+
+    return (readResponse() == GSMResponseOK);
+}
+
+// Prints the data of a string parameter, escaping characters as \XX
+void Sodaq_R4X::httpPrintEscaped(const uint8_t* data, size_t size)
+{
+    for (size_t i = 0; i < size; i++) {
+        if (http_needs_escape(data[i])) {
+            print('\\');
+            print(static_cast<char>(NIBBLE_TO_HEX_CHAR(HIGH_NIBBLE(data[i]))));
+            print(static_cast<char>(NIBBLE_TO_HEX_CHAR(LOW_NIBBLE(data[i]))));
         }
         else {
-            // On AVR this can give size_t overflow
-            return file_size;
+            print(static_cast<char>(data[i]));
         }
     }
-    else if (_httpRequestSuccessBit[requestType] == TriBoolFalse) {
-        debugPrintln(DEBUG_STR_ERROR "An error occurred with the http request!");
-        return 0;
+}
+
+bool Sodaq_R4X::httpCaptureHeader(uint8_t index, const char* name)
+{
+    if (index >= SODAQ_R4X_HTTP_MAX_CAPTURED_HEADERS) {
+        return false;
     }
-    else {
-        debugPrintln(DEBUG_STR_ERROR "Timed out waiting for a response for the http request!");
-        return 0;
+
+    _httpCapturedHeaders[index] = name;
+
+    return true;
+}
+
+void Sodaq_R4X::httpResetResponse()
+{
+    memset(&_httpResponse, 0, sizeof(_httpResponse));
+    _httpHeaderLineSize = 0;
+}
+
+/**
+ * Scan a block of the response header
+ *
+ * The header lines in the block are parsed into _httpResponse, lines that
+ * continue in the next block are kept in _httpHeaderLine.
+ * Returns the number of bytes up to and including the empty line, or size
+ * if the end of the header was not found.
+ */
+size_t Sodaq_R4X::httpScanHeader(const uint8_t* data, size_t size, uint8_t& state)
+{
+    size_t headerSize = http_scan_header_end(data, size, state);
+
+    for (size_t i = 0; i < headerSize; i++) {
+        if (data[i] == '\n') {
+            _httpHeaderLine[_httpHeaderLineSize] = 0;
+            httpParseHeaderLine();
+            _httpHeaderLineSize = 0;
+        }
+        else if (data[i] != '\r' && _httpHeaderLineSize < sizeof(_httpHeaderLine) - 1) {
+            _httpHeaderLine[_httpHeaderLineSize++] = data[i];
+        }
     }
 
-    return 0;
+    return headerSize;
 }
 
+void Sodaq_R4X::httpParseHeaderLine()
+{
+    char* line = _httpHeaderLine;
+
+    if (_httpResponse.statusCode == 0) {
+        // Status line, e.g. "HTTP/1.1 200 OK"
+        unsigned int statusCode;
+        if (sscanf(line, "HTTP/%*s %u", &statusCode) == 1) {
+            _httpResponse.statusCode = statusCode;
+        }
+        return;
+    }
+
+    char* value = strchr(line, ':');
+    if (!value) {
+        return;
+    }
+
+    *value++ = 0;
+    while (*value == ' ' || *value == '\t') {
+        value++;
+    }
+
+    char* dest = NULL;
+
+    if (strcasecmp(line, "Content-Length") == 0) {
+        _httpResponse.hasContentLength = true;
+        _httpResponse.contentLength = strtoul(value, NULL, 10);
+    }
+    else if (strcasecmp(line, "Content-Type") == 0) {
+        dest = _httpResponse.contentType;
+    }
+    else if (strcasecmp(line, "ETag") == 0) {
+        dest = _httpResponse.etag;
+    }
+    else if (strcasecmp(line, "Content-Encoding") == 0) {
+        dest = _httpResponse.contentEncoding;
+    }
+
+    if (dest) {
+        strncpy(dest, value, SODAQ_R4X_HTTP_HEADER_VALUE_SIZE - 1);
+    }
+
+    for (uint8_t i = 0; i < SODAQ_R4X_HTTP_MAX_CAPTURED_HEADERS; i++) {
+        if (_httpCapturedHeaders[i] && strcasecmp(line, _httpCapturedHeaders[i]) == 0) {
+            strncpy(_httpResponse.captured[i], value, SODAQ_R4X_HTTP_HEADER_VALUE_SIZE - 1);
+        }
+    }
+}
 
 //  Paremeter index has a range [0-4]
 //  Parameters 'name' and 'value' can have a maximum length of 64 characters
 //  Parameters 'name' and 'value' must not include the ':' character
+//  Quotes in the value are escaped, e.g. for an ETag
 bool Sodaq_R4X::httpSetCustomHeader(uint8_t index, const char* name, const char* value)
 {
+    if (index >= SODAQ_HTTP_HEADER_SLOTS) {
+        return false;
+    }
+
+    uint32_t hash = http_header_hash(name, value);
+
+    if (hash == _httpHeaderHash[index]) {
+        return true;
+    }
+
     print("AT+UHTTP=0,9,\"");
     print(index);
     print(':');
@@ -2098,12 +3257,20 @@ bool Sodaq_R4X::httpSetCustomHeader(uint8_t index, const char* name, const char*
     if (name != NULL) {
         print(name);
         print(':');
-        print(value);
+        httpPrintEscaped((const uint8_t*)value, strlen(value));
     }
 
     println('"');
 
-    return (readResponse() == GSMResponseOK);
+    if (readResponse() != GSMResponseOK) {
+        // the slot is unknown now, the next call sends it again
+        _httpHeaderHash[index] = FNV1A_INIT;
+        return false;
+    }
+
+    _httpHeaderHash[index] = hash;
+
+    return true;
 }
 
 bool Sodaq_R4X::httpClearCustomHeader(uint8_t index)
@@ -2111,6 +3278,17 @@ bool Sodaq_R4X::httpClearCustomHeader(uint8_t index)
     return httpSetCustomHeader(index, NULL, NULL);
 }
 
+bool Sodaq_R4X::httpApplyHeaders(const Sodaq_HttpHeaders& headers)
+{
+    for (uint8_t i = 0; i < SODAQ_HTTP_HEADER_SLOTS; i++) {
+        if (headers.isUsed(i) && !httpSetCustomHeader(i, headers.getName(i), headers.getValue(i))) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 
 /******************************************************************************
 * Files
@@ -2225,36 +3403,67 @@ size_t Sodaq_R4X::readFile(const char* filename, uint8_t* buffer, size_t size)
 
 size_t Sodaq_R4X::readFilePartial(const char* filename, uint8_t* buffer, size_t size, uint32_t offset)
 {
-    // TODO escape filename characters { '"', ',', }
-
     if (!buffer || size == 0) {
         return 0;
     }
 
+    readFileBlockRequest(filename, offset, size);
+
+    size_t blocksize = readFileBlockHeader(size);
+    if (blocksize == 0) {
+        return 0;
+    }
+
+    // actual file buffer, written directly to the provided result buffer
+    if (readFileBlockData(buffer, blocksize) != blocksize) {
+        debugPrintln(DEBUG_STR_ERROR "File size error!");
+        return 0;
+    }
+
+    return (readFileBlockEnd() ? blocksize : 0);
+}
+
+void Sodaq_R4X::readFileBlockRequest(const char* filename, uint32_t offset, size_t size)
+{
+    // TODO escape filename characters { '"', ',', }
+
     print("AT+URDBLOCK=\"");
     print(filename);
     print("\",");
     print(offset);
     print(',');
     println(size);
+}
 
-    char reply_buffer[256];       // Filenames can be 248 chars long
+/**
+ * Read the reply of AT+URDBLOCK up to the data
+ *
+ * The reply looks like
+ *   +URDBLOCK: http_last_response_0,86,"..."
+ * where 86 is an example of the size. The file name can be 248 chars long,
+ * it is skipped without buffering it.
+ */
+size_t Sodaq_R4X::readFileBlockHeader(size_t size)
+{
+    char reply_buffer[16];
 
     // Read reply identifier
-    //   +URDBLOCK: http_last_response_0,86,"..."
-    // where 86 is an example of the size
-    size_t len = readBytesUntil(' ', reply_buffer, sizeof(reply_buffer));
+    size_t len = readBytesUntil(' ', reply_buffer, sizeof(reply_buffer) - 1);
+    reply_buffer[len] = '\0';
     if (len == 0 || strstr(reply_buffer, "+URDBLOCK:") == NULL) {
         debugPrintln(DEBUG_STR_ERROR "+URDBLOCK literal is missing!");
         return 0;
     }
 
     // skip filename
-    len = readBytesUntil(',', reply_buffer, sizeof(reply_buffer));
     // TODO check filename. Note, there are no quotes. ??Manual example has qotes
+    int c;
+    while ((c = timedRead()) >= 0 && c != ',') {
+    }
 
     // read the number of bytes
-    len = readBytesUntil(',', reply_buffer, sizeof(reply_buffer));
+    len = readBytesUntil(',', reply_buffer, sizeof(reply_buffer) - 1);
+    reply_buffer[len] = '\0';
     uint32_t blocksize = 0; // reset the var before reading from reply string
     if (sscanf(reply_buffer, "%lu", &blocksize) != 1) {
         debugPrintln(DEBUG_STR_ERROR "Could not parse the block size!");
@@ -2266,48 +3475,48 @@ size_t Sodaq_R4X::readFilePartial(const char* filename, uint8_t* buffer, size_t
     }
 
     // opening quote character
-    char quote = timedRead();
-    if (quote != '"') {
+    if (timedRead() != '"') {
         debugPrintln(DEBUG_STR_ERROR "Missing starting character (quote)!");
         return 0;
     }
 
-    // actual file buffer, written directly to the provided result buffer
-    len = readBytes(buffer, blocksize);
-    if (len != blocksize) {
-        debugPrintln(DEBUG_STR_ERROR "File size error!");
-        return 0;
-    }
+    return blocksize;
+}
+
+size_t Sodaq_R4X::readFileBlockData(uint8_t* buffer, size_t size)
+{
+    return readBytes(buffer, size);
+}
 
+bool Sodaq_R4X::readFileBlockEnd()
+{
     // closing quote character
-    quote = timedRead();
-    if (quote != '"') {
+    if (timedRead() != '"') {
         debugPrintln(DEBUG_STR_ERROR "Missing termination character (quote)!");
-        return 0;
+        return false;
     }
 
-    // read final OK response from modem and return the filesize
-    return (readResponse() == GSMResponseOK ? blocksize : 0);
+    // read final OK response from modem
+    return (readResponse() == GSMResponseOK);
 }
 
 // If the file already exists, the data will be appended to the file already stored in the file system.
 bool Sodaq_R4X::writeFile(const char* filename, const uint8_t* buffer, size_t size)
 {
-    // TODO escape filename characters
-    print("AT+UDWNFILE=\"");
-    print(filename);
-    print("\",");
-    println(size);
+    size_t offset = 0;
 
-    if (waitForFilePrompt(250)) {
-        return false;
-    }
+    // An empty write still creates the file
+    do {
+        size_t chunkSize = min(size - offset, (size_t)SODAQ_R4X_FILE_WRITE_CHUNK_SIZE);
 
-    for (size_t i = 0; i < size; i++) {
-        writeByte(buffer[i]);
-    }
+        if (!writeFileChunk(filename, &buffer[offset], chunkSize)) {
+            return false;
+        }
 
-    return (readResponse() == GSMResponseOK);
+        offset += chunkSize;
+    } while (offset < size);
+
+    return true;
 }
 
 
@@ -2586,6 +3795,23 @@ bool Sodaq_R4X::checkURC(const char* buffer)
         return true;
     }
 
+    if (sscanf(buffer, "+UUHTTPCR: %d,%*d,%d", &param1, &param2) == 2 && param1 > 0) {
+        debugPrint("Unsolicited: UUHTTPCR profile ");
+        debugPrint(param1);
+        debugPrint(": ");
+        debugPrintln(param2);
+
+        if (param1 < SODAQ_R4X_HTTP_PROFILE_COUNT) {
+            _httpProfileResult[param1] = (param2 == 1) ? TriBoolTrue : TriBoolFalse;
+        }
+
+        if (_httpCompletionHandler) {
+            _httpCompletionHandler(param1, param2 == 1);
+        }
+
+        return true;
+    }
+
     if (sscanf(buffer, "+UUHTTPCR: 0,%d,%d", &param1, &param2) == 2) {
         static uint8_t mapping[] = {
             HEAD,   // 0
@@ -2593,6 +3819,7 @@ bool Sodaq_R4X::checkURC(const char* buffer)
             DELETE, // 2
             PUT,    // 3
             POST,   // 4
+            POST,   // 5 POST data
         };
 
         int requestType = param1 < (int)sizeof(mapping) ? mapping[param1] : -1;
@@ -2608,6 +3835,10 @@ bool Sodaq_R4X::checkURC(const char* buffer)
             else if (param2 == 1) {
                 _httpRequestSuccessBit[requestType] = TriBoolTrue;
             }
+
+            if (_httpCompletionHandler) {
+                _httpCompletionHandler(0, param2 == 1);
+            }
         }
 
         return true;
@@ -2630,7 +3861,8 @@ bool Sodaq_R4X::checkURC(const char* buffer)
         debugPrint(", ");
         debugPrintln(param3);
 
-       _mqttSubscribeReason = param1;
+        _mqttSubscribeReason = param1;
+        mqttSubscribeResult(param3, param1, param2);
 
         return true;
     }
@@ -2724,6 +3956,8 @@ void Sodaq_R4X::reboot()
 
     execCommand("AT+CFUN=15");
     _echoOff = false;
+    memset(_httpProfileHash, 0, sizeof(_httpProfileHash));
+    memset(_httpHeaderHash, 0, sizeof(_httpHeaderHash));
 
     // wait for the reboot to start
     sodaq_wdt_safe_delay(REBOOT_DELAY);
@@ -2778,6 +4012,33 @@ bool Sodaq_R4X::waitForFilePrompt(uint32_t timeout)
     return waitForPrompt(STR_RESPONSE_FILE_PROMPT, timeout);
 }
 
+/**
+ * Append one chunk to the file with AT+UDWNFILE
+ *
+ * The data is written to the UART in one go after the prompt. The modem
+ * replies OK when the chunk is stored.
+ */
+bool Sodaq_R4X::writeFileChunk(const char* filename, const uint8_t* buffer, size_t size)
+{
+    // TODO escape filename characters
+    print("AT+UDWNFILE=\"");
+    print(filename);
+    print("\",");
+    println(size);
+
+    if (!waitForFilePrompt(250)) {
+        debugPrintln(DEBUG_STR_ERROR "No file prompt!");
+        return false;
+    }
+
+    if (size > 0 && writeBytes(buffer, size) != size) {
+        debugPrintln(DEBUG_STR_ERROR "Could not write the file data!");
+        return false;
+    }
+
+    return (readResponse() == GSMResponseOK);
+}
+
 
 /******************************************************************************
  * OnOff
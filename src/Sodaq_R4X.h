@@ -35,9 +35,38 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <Arduino.h>
 
 #include "Sodaq_Ublox.h"
+#include "Sodaq_HttpHeaders.h"
 
 #define SODAQ_MAX_SEND_MESSAGE_SIZE     512
 #define SODAQ_R4X_MAX_SOCKET_BUFFER     1024
+#define SODAQ_R4X_MAX_MQTT_BINARY_SIZE  1024
+#define SODAQ_R4X_MAX_MQTT_INLINE_SIZE  1024
+#define SODAQ_R4X_MQTT_PROFILE_FILENAME "mqtt_profile_fp"
+#define SODAQ_R4X_MAX_PENDING_SUBSCRIPTIONS 16
+
+#define SODAQ_R4X_HTTP_PROFILE_COUNT 4
+
+// writeFile() sends larger buffers in more AT+UDWNFILE commands of this size
+#ifndef SODAQ_R4X_FILE_WRITE_CHUNK_SIZE
+#define SODAQ_R4X_FILE_WRITE_CHUNK_SIZE 1024
+#endif
+
+// POST bodies up to this size (after escaping) are sent in the AT+UHTTPC command
+#ifndef SODAQ_R4X_HTTP_INLINE_POST_SIZE
+#define SODAQ_R4X_HTTP_INLINE_POST_SIZE 128
+#endif
+
+#ifndef SODAQ_R4X_HTTP_MAX_CAPTURED_HEADERS
+#define SODAQ_R4X_HTTP_MAX_CAPTURED_HEADERS 2
+#endif
+#define SODAQ_R4X_HTTP_HEADER_VALUE_SIZE    64
+
+// The custom header slot of http profile 0 that httpGetStream() uses to send
+// Accept-Encoding when an inflater is set, see httpSetInflater()
+#ifndef SODAQ_R4X_HTTP_INFLATE_HEADER_SLOT
+#define SODAQ_R4X_HTTP_INFLATE_HEADER_SLOT  4
+#endif
+#define SODAQ_R4X_HTTP_HEADER_LINE_SIZE     128
 
 /**
  * The value for AT+URAT=
@@ -72,6 +101,17 @@ enum HttpRequestTypes {
     HttpRequestTypesMAX
 };
 
+// The content type of a POST request, values of AT+UHTTPC
+enum HttpContentTypes
+{
+    HttpContentFormUrlEncoded,
+    HttpContentTextPlain,
+    HttpContentOctetStream,
+    HttpContentMultipartFormData,
+    HttpContentJson,
+    HttpContentXml
+};
+
 /**
  * Values for MNO profile (AT+UMNOPROF)
  * • 0: Undefined
@@ -126,9 +166,84 @@ enum TriBoolStates
 typedef TriBoolStates tribool_t;
 
 typedef void(*PublishHandlerPtr)(const char* topic, const char* msg);
+typedef void(*SubscribeHandlerPtr)(const char* filter, bool success, uint8_t qos);
+
+/**
+ * Metadata of an HTTP response, parsed from its header
+ *
+ * Values that do not fit are truncated. Headers that are not present
+ * are empty strings.
+ */
+typedef struct
+{
+    uint16_t statusCode;            //< 0 if no header has been parsed
+    bool     hasContentLength;
+    uint32_t contentLength;
+    uint32_t headerSize;            //< Size of the header including the empty line
+    char     contentType[SODAQ_R4X_HTTP_HEADER_VALUE_SIZE];
+    char     etag[SODAQ_R4X_HTTP_HEADER_VALUE_SIZE];
+    char     contentEncoding[SODAQ_R4X_HTTP_HEADER_VALUE_SIZE];
+    // Values of the headers selected with httpCaptureHeader()
+    char     captured[SODAQ_R4X_HTTP_MAX_CAPTURED_HEADERS][SODAQ_R4X_HTTP_HEADER_VALUE_SIZE];
+} http_response_t;
+
+// Receives the body of an HTTP response in chunks, offset is the position in the body
+typedef void(*HttpBodyHandlerPtr)(const uint8_t* data, size_t size, uint32_t offset);
+// Called when the +UUHTTPCR URC of a request on the profile is received
+typedef void(*HttpCompletionHandlerPtr)(uint8_t profile, bool success);
+// Fills the buffer with the next part of a request body, offset is the position in the body.
+// Returns the number of bytes, 0 at the end of the body.
+typedef size_t(*HttpBodyGeneratorPtr)(uint8_t* buffer, size_t size, uint32_t offset);
+// Reports the number of bytes that are stored in a file on the modem, used by
+// httpUpload() and Sodaq_FileWriter
+typedef void(*WriteProgressHandlerPtr)(uint32_t bytesWritten);
+
+/**
+ * A (part of a) received MQTT message
+ *
+ * Messages that do not fit in the input buffer are passed on in several
+ * chunks. The pointers point into the input buffer and are only valid
+ * during the call of the handler.
+ */
+typedef struct
+{
+    const char*    topic;       //< Topic name, NUL terminated
+    const uint8_t* payload;     //< The payload bytes of this chunk
+    size_t         size;        //< Number of payload bytes in this chunk
+    size_t         offset;      //< Position of this chunk in the message
+    size_t         length;      //< Total message length, 0 if not known
+    uint8_t        qos;         //< Quality of Service of the message
+    bool           last;        //< True for the final chunk of a message
+} mqtt_message_t;
+
+typedef void(*MessageHandlerPtr)(const mqtt_message_t* msg);
+
+/**
+ * Settings of the MQTT client of the modem, see mqttSetProfile()
+ *
+ * Strings that are NULL and numbers that are 0 are not set.
+ */
+typedef struct
+{
+    const char* server;             //< Host name of the broker
+    const char* serverIP;           //< IP address of the broker, if there is no host name
+    uint16_t    port;               //< 0 selects the default port
+    const char* clientId;
+    const char* username;
+    const char* password;
+    uint16_t    localPort;
+    uint16_t    inactivityTimeout;  //< In seconds
+    bool        cleanSession;
+    bool        secure;
+    int8_t      secureProfile;      //< -1 selects the default security profile
+} mqtt_profile_t;
 
 #define BAND_TO_MASK(x) (1 << (x - 1))
 
+class Sodaq_Inflate;
+class Sodaq_MqttRouter;
+class Sodaq_MqttStore;
+
 class Sodaq_SARA_R4XX_OnOff : public Sodaq_OnOffBee
 {
 public:
@@ -249,10 +364,26 @@ public:
 
     bool mqttLogin(uint32_t timeout = 3 * 60 * 1000);
     bool mqttLogout();
-    void mqttLoop();
+    // Handles all MQTT URCs that have been received, without waiting for more.
+    // Returns the number of handled URCs.
+    size_t mqttLoop();
     bool mqttPing(const char* server);
+    // Payloads that cannot be sent as quoted text (binary data, '"', CR/LF) are
+    // automatically published with mqttPublishBinary(), unless useHEX is set.
+    // Payloads larger than SODAQ_R4X_MAX_MQTT_INLINE_SIZE (after HEX encoding)
+    // are staged in a file on the modem and published with mqttPublishFromFile().
     bool mqttPublish(const char* topic, const uint8_t* msg, size_t size, uint8_t qos = 0, uint8_t retain = 0, bool useHEX = false);
+    // Publishes the raw payload bytes after the '>' prompt (AT+UMQTTC=9).
+    // The size is limited to SODAQ_R4X_MAX_MQTT_BINARY_SIZE.
+    bool mqttPublishBinary(const char* topic, const uint8_t* msg, size_t size, uint8_t qos = 0, uint8_t retain = 0);
+    // Publishes the contents of a file on the modem file system (AT+UMQTTC=3).
+    bool mqttPublishFromFile(const char* topic, const char* filename, uint8_t qos = 0, uint8_t retain = 0);
     uint16_t mqttReadMessages(char* buffer, size_t size, uint32_t timeout = 60 * 1000);
+    // Reads the pending messages and passes them, chunk by chunk, to the handler,
+    // or to the router (see mqttSetRouter) if the handler is NULL.
+    // With maxMessages > 0 the messages are fetched one at a time, and at most
+    // maxMessages are read. Returns the number of read messages.
+    uint16_t mqttStreamMessages(MessageHandlerPtr handler, uint16_t maxMessages = 0, uint32_t timeout = 60 * 1000);
 
     bool mqttSetAuth(const char* name, const char* pw);
     bool mqttSetCleanSession(bool enabled);
@@ -262,10 +393,32 @@ public:
     bool mqttSetSecureOption(bool enabled, int8_t profile = -1);
     bool mqttSetServer(const char* server, uint16_t port);
     bool mqttSetServerIP(const char* ip, uint16_t port);
+    // Applies all settings of the profile and stores them in the NVM of the modem.
+    // If the stored profile is the same (see SODAQ_R4X_MQTT_PROFILE_FILENAME) it is
+    // only restored from the NVM, with a single command.
+    bool mqttSetProfile(const mqtt_profile_t* profile);
+    // Restores the settings from the NVM of the modem (AT+UMQTTNV=1).
+    bool mqttRestoreProfile();
+    // Stores the current settings in the NVM of the modem (AT+UMQTTNV=2).
+    bool mqttSaveProfile();
 
     bool mqttSubscribe(const char* filter, uint8_t qos = 0, uint32_t timeout = 30 * 1000);
+    // Sends all subscriptions back to back and then waits for their results.
+    // qos may be NULL for QoS 0. Returns the number of successful subscriptions.
+    uint8_t mqttSubscribeMany(const char* const* filters, const uint8_t* qos, uint8_t count, uint32_t timeout = 30 * 1000);
+    // Sends the subscription without waiting for the result. The result is passed
+    // to the handler of mqttSetSubscribeHandler() when it arrives.
+    bool mqttSubscribeAsync(const char* filter, uint8_t qos = 0);
+    uint8_t mqttGetPendingSubscriptions();
+    void mqttSetSubscribeHandler(SubscribeHandlerPtr handler) { _mqttSubscribeHandler = handler; }
     bool mqttUnsubscribe(const char* filter);
+    // Returns the number of accepted unsubscriptions.
+    uint8_t mqttUnsubscribeMany(const char* const* filters, uint8_t count);
     void mqttSetPublishHandler(PublishHandlerPtr handler);
+    // Received messages are dispatched to the handlers of the router.
+    void mqttSetRouter(Sodaq_MqttRouter* router) { _mqttRouter = router; }
+    // The stored messages are published after every successful mqttLogin().
+    void mqttSetStore(Sodaq_MqttStore* store) { _mqttStore = store; }
 
     /******************************************************************************
     * HTTP
@@ -284,9 +437,23 @@ public:
     // Offset 0 is the byte directly after the HTTP Response header
     size_t httpGetPartial(uint8_t* buffer, size_t size, uint32_t offset);
 
+    // Creates an HTTP GET request and passes the body of the response to the handler.
+    // The buffer is used to read the response, see httpStreamResponse().
+    // Returns the size of the body.
+    uint32_t httpGetStream(const char* server, uint16_t port, const char* endpoint,
+                           HttpBodyHandlerPtr handler, uint8_t* buffer, size_t bufferSize,
+                           uint32_t timeout = 60000, bool useURC = true);
+
+    // Reads the response file of the previous HTTP request in blocks of the buffer size,
+    // and passes the body to the handler. The header is skipped in the same pass.
+    // A gzip or deflate encoded body is decoded if an inflater is set.
+    // Returns the size of the (decoded) body, or 0 if the response could not be read.
+    uint32_t httpStreamResponse(HttpBodyHandlerPtr handler, uint8_t* buffer, size_t bufferSize);
+
     // Creates an HTTP POST request and optionally returns the received data.
     // Note. Endpoint should include the initial "/".
     // The UBlox device stores the received data in http_last_response_<profile_id>
+    // Bodies up to SODAQ_R4X_HTTP_INLINE_POST_SIZE are sent without a file on the modem.
     uint32_t httpPost(const char* server, uint16_t port, const char* endpoint,
                       char* responseBuffer, size_t responseSize,
                       const char* sendBuffer, size_t sendSize, uint32_t timeout = 60000, bool useURC = true);
@@ -317,12 +484,73 @@ public:
                        char* responseBuffer = NULL, size_t responseSize = 0,
                        const char* fileName = NULL, uint32_t timeout = 60000, bool useURC = true);
 
+    // Configures http profile 0 for the server. Custom headers must be set after this,
+    // changing the server clears them. The requests to the same server keep them.
+    bool httpSetServer(const char* server, uint16_t port = 80);
+
+    // Creates an HTTP GET request and stores the response, including the header, in the file.
+    // Returns the size of the file, or 0 if the request failed.
+    uint32_t httpGetToFile(const char* server, uint16_t port, const char* endpoint,
+                           const char* fileName, uint32_t timeout = 60000);
+
+    // Creates an HTTP PUT or POST request with a body that is produced by the generator.
+    // The body is appended to a file on the modem in chunks of the buffer size, so it
+    // does not need to fit in RAM. The progress handler is called after every chunk.
+    // Returns the size of the response, see httpRequest().
+    size_t httpUpload(const char* server, uint16_t port, const char* endpoint, HttpRequestTypes requestType,
+                      HttpBodyGeneratorPtr generator, uint8_t* buffer, size_t bufferSize,
+                      WriteProgressHandlerPtr progress = NULL, uint32_t timeout = 60000, bool useURC = true);
+
+    // Sets the handler that is called when the +UUHTTPCR URC of any profile is handled,
+    // e.g. by poll(), while the application does other work.
+    void httpSetCompletionHandler(HttpCompletionHandlerPtr handler) { _httpCompletionHandler = handler; }
+
+    // Sets the content type of the POST requests, the default is HttpContentTextPlain
+    void httpSetContentType(HttpContentTypes contentType) { _httpContentType = contentType; }
+
+    // Starts an HTTP request on a free profile and returns without waiting for the response.
+    // Several requests can be in flight, profile 0 stays in use by the blocking requests above.
+    // The request body is written to http_tmp_put_<profile>.
+    // Returns the profile, or -1 if there is no free profile or the request could not be sent.
+    int8_t httpRequestAsync(const char* server, uint16_t port, const char* endpoint,
+                            HttpRequestTypes requestType = HttpRequestTypes::GET,
+                            const char* sendBuffer = NULL, size_t sendSize = 0);
+    // TriBoolUndefined while the request is in progress, the result is set by the URC
+    // that is handled by poll() or any other command.
+    tribool_t httpGetRequestResult(int8_t profile);
+    // Waits until the request of the profile has completed, returns true if it succeeded.
+    // No commands are sent while waiting.
+    bool httpWaitForRequest(int8_t profile, uint32_t timeout = 60000);
+    // Reads the body of the response of the profile, offset 0 is the byte directly after the header.
+    size_t httpReadResponse(int8_t profile, uint8_t* buffer, size_t size, uint32_t offset = 0);
+    // Frees the profile for a next request
+    void httpReleaseProfile(int8_t profile);
+
+    // The metadata of the last response. It is parsed when the header is scanned,
+    // by httpGet(), httpPost(), httpGetHeaderSize() or httpStreamResponse().
+    const http_response_t& httpGetResponse() const { return _httpResponse; }
+    // Selects a header (case insensitive) to capture in http_response_t.captured[index].
+    // The name is not copied. NULL stops capturing at that index.
+    bool httpCaptureHeader(uint8_t index, const char* name);
+
     //  Paremeter index has a range [0-4]
     //  Parameters 'name' and 'value' can have a maximum length of 64 characters
     //  Parameters 'name' and 'value' must not include the ':' character
+    //  Nothing is sent if the slot already holds the header.
     bool httpSetCustomHeader(uint8_t index, const char* name, const char* value);
     bool httpClearCustomHeader(uint8_t index);
 
+    // Sets the slots of the header set at once, only the changed slots are sent.
+    bool httpApplyHeaders(const Sodaq_HttpHeaders& headers);
+    // The header set is applied before every blocking request, after the server
+    // is configured. NULL stops using it.
+    void httpSetHeaders(const Sodaq_HttpHeaders* headers) { _httpHeaders = headers; }
+    // With an inflater httpGetStream() accepts compressed responses, and
+    // httpStreamResponse() decodes them. Accept-Encoding is sent in the custom
+    // header slot SODAQ_R4X_HTTP_INFLATE_HEADER_SLOT, the next other request
+    // clears it again. Do not use that slot in the header set. NULL to disable.
+    void httpSetInflater(Sodaq_Inflate* inflater) { _httpInflater = inflater; }
+
 
     /******************************************************************************
     * Files
@@ -333,7 +561,16 @@ public:
     size_t readFile(const char* filename, uint8_t* buffer, size_t size);
     size_t readFilePartial(const char* filename, uint8_t* buffer, size_t size, uint32_t offset);
 
+    // readFilePartial() in steps, to pass the data on while it is received.
+    // No other command can be sent from the request until the end is read.
+    void   readFileBlockRequest(const char* filename, uint32_t offset, size_t size);
+    // Returns the size of the block, at most size, or 0 on an error
+    size_t readFileBlockHeader(size_t size);
+    size_t readFileBlockData(uint8_t* buffer, size_t size);
+    bool   readFileBlockEnd();
+
     // If the file already exists, the data will be appended to the file already stored in the file system.
+    // The data is sent in chunks of SODAQ_R4X_FILE_WRITE_CHUNK_SIZE, each one is confirmed by the modem.
     bool   writeFile(const char* filename, const uint8_t* buffer, size_t size);
 
 protected:
@@ -354,6 +591,29 @@ private:
 
     bool    getOperatorInfo_low(char* buffer, size_t size);
 
+    void   mqttWaitForPendingMessages(uint32_t startTime, uint32_t timeout);
+    bool   mqttStreamMessage(MessageHandlerPtr handler, uint32_t startTime, uint32_t timeout);
+    void   mqttDispatchMessage(MessageHandlerPtr handler, const mqtt_message_t* msg);
+    bool   mqttApplyProfile(const mqtt_profile_t* profile);
+    bool   httpSetProfile(uint8_t profile, const char* server, uint16_t port);
+    bool   httpSendRequest(uint8_t profile, const char* server, uint16_t port, const char* endpoint,
+                           HttpRequestTypes requestType, const char* fileName,
+                           const uint8_t* data = NULL, size_t dataSize = 0,
+                           const char* responseFileName = NULL);
+    size_t httpWaitForResponse(HttpRequestTypes requestType, char* responseBuffer, size_t responseSize,
+                               uint32_t timeout, bool useURC);
+    uint32_t httpPostResponse(uint32_t fileSize, char* responseBuffer, size_t responseSize);
+    void   httpPrintEscaped(const uint8_t* data, size_t size);
+    void   httpWaitForUrc(const tribool_t& result, uint32_t timeout);
+    void   httpResetResponse();
+    size_t httpScanHeader(const uint8_t* data, size_t size, uint8_t& state);
+    void   httpParseHeaderLine();
+
+    bool   mqttSubscribeCommand(const char* filter, uint8_t qos);
+    int8_t mqttAddPendingSubscription(const char* filter, bool async);
+    void   mqttSubscribeResult(const char* filter, int8_t result, uint8_t qos);
+    bool   mqttNvm(uint8_t mode);
+
     void   reboot();
     bool   setSimPin(const char* simPin);
 
@@ -363,13 +623,38 @@ private:
      *****************************************************************************/
 
     uint32_t    _httpGetHeaderSize;
+    // Fingerprint of the settings of each http profile, 0 if unknown
+    uint32_t    _httpProfileHash[SODAQ_R4X_HTTP_PROFILE_COUNT];
+    // State of the requests of httpRequestAsync()
+    bool        _httpProfileBusy[SODAQ_R4X_HTTP_PROFILE_COUNT];
+    tribool_t   _httpProfileResult[SODAQ_R4X_HTTP_PROFILE_COUNT];
+    uint32_t    _httpProfileHeaderSize[SODAQ_R4X_HTTP_PROFILE_COUNT];
+    http_response_t _httpResponse;
+    const char* _httpCapturedHeaders[SODAQ_R4X_HTTP_MAX_CAPTURED_HEADERS];
+    // The header line that is being parsed
+    char        _httpHeaderLine[SODAQ_R4X_HTTP_HEADER_LINE_SIZE];
+    size_t      _httpHeaderLineSize;
     tribool_t   _httpRequestSuccessBit[HttpRequestTypesMAX];
+    HttpContentTypes _httpContentType;
+    HttpCompletionHandlerPtr _httpCompletionHandler;
+    const Sodaq_HttpHeaders* _httpHeaders;
+    Sodaq_Inflate* _httpInflater;
+    // Set while httpGetStream() sends its request
+    bool        _httpAcceptEncoding;
+    // Fingerprint of the custom header in each slot of http profile 0, 0 if empty
+    uint32_t    _httpHeaderHash[SODAQ_HTTP_HEADER_SLOTS];
     int8_t      _mqttLoginResult;
     int16_t     _mqttPendingMessages;
     int8_t      _mqttSubscribeReason;
+    // The subscriptions that wait for their +UUMQTTC: 4 result, matched by filter hash
+    uint32_t    _mqttSubscriptionHash[SODAQ_R4X_MAX_PENDING_SUBSCRIPTIONS];
+    int8_t      _mqttSubscriptionResult[SODAQ_R4X_MAX_PENDING_SUBSCRIPTIONS];
     bool        _networkStatusLED;
 
     PublishHandlerPtr _mqttPublishHandler = NULL;
+    SubscribeHandlerPtr _mqttSubscribeHandler = NULL;
+    Sodaq_MqttRouter* _mqttRouter = NULL;
+    Sodaq_MqttStore*  _mqttStore = NULL;
 
     uint32_t    _umqtt_timeout;
 
@@ -400,6 +685,7 @@ private:
 
     bool waitForSocketPrompt(uint32_t timeout);
     bool waitForFilePrompt(uint32_t timeout);
+    bool writeFileChunk(const char* filename, const uint8_t* buffer, size_t size);
 };
 
 #endif
@@ -90,6 +90,7 @@ Sodaq_Ublox::Sodaq_Ublox()
     _isBufferInitialized = false;
     _inputBuffer         = 0;
     _inputBufferSize     = SODAQ_UBLOX_DEFAULT_INPUT_BUFFER_SIZE;
+    _pollLineLength      = 0;
 
     _diagPrint = 0;
     _appendCommand = false;
@@ -655,12 +656,14 @@ size_t Sodaq_Ublox::readBytes(uint8_t* buffer, size_t length, uint32_t timeout)
 // Returns the number of bytes read, not including the null terminator.
 size_t Sodaq_Ublox::readLn(char* buffer, size_t size, uint32_t timeout)
 {
+    pollFinishLine();
+
     // Use size-1 to leave room for a string terminator
     size_t len = readBytesUntil(SODAQ_UBLOX_TERMINATOR[SODAQ_UBLOX_TERMINATOR_LEN - 1], buffer, size - 1, timeout);
 
     // check if the terminator is more than 1 characters, then check if the first character of it exists
     // in the calculated position and terminate the string there
-    if ((SODAQ_UBLOX_TERMINATOR_LEN > 1) &&
+    if ((SODAQ_UBLOX_TERMINATOR_LEN > 1) && (len >= SODAQ_UBLOX_TERMINATOR_LEN - 1) &&
         (buffer[len - (SODAQ_UBLOX_TERMINATOR_LEN - 1)] == SODAQ_UBLOX_TERMINATOR[0])) {
         len -= SODAQ_UBLOX_TERMINATOR_LEN - 1;
     }
@@ -671,9 +674,80 @@ size_t Sodaq_Ublox::readLn(char* buffer, size_t size, uint32_t timeout)
     return len;
 }
 
+/**
+ * Handle the URCs that have already been received
+ *
+ * Only the characters that are available are read, so this never waits
+ * for the modem. Every complete line is passed to checkURC(). A partial
+ * line is kept in its own buffer, and completed by the next call, or by
+ * pollFinishLine() when a command is sent or a line is read.
+ */
+size_t Sodaq_Ublox::poll()
+{
+    size_t count = 0;
+
+    sodaq_wdt_reset();
+
+    while (_modemUART->available() > 0) {
+        int c = _modemUART->read();
+        if (c < 0) {
+            break;
+        }
+
+        if (pollAppend(c)) {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+bool Sodaq_Ublox::pollAppend(int c)
+{
+    bool eol = (c < 0) || (c == SODAQ_UBLOX_TERMINATOR[SODAQ_UBLOX_TERMINATOR_LEN - 1]);
+    if (!eol) {
+        _pollLine[_pollLineLength++] = static_cast<char>(c);
+
+        // A line that does not fit is handled like readLn() does, in parts
+        if (_pollLineLength < sizeof(_pollLine)) {
+            return false;
+        }
+    }
+
+    size_t len = _pollLineLength;
+    _pollLineLength = 0;
+
+    if (c >= 0 && eol && len > 0 && _pollLine[len - 1] == SODAQ_UBLOX_TERMINATOR[0]) {
+        len--;
+    }
+
+    if (len == 0) {
+        return false;
+    }
+
+    // URC handlers expect the line in the input buffer
+    len = min(len, _inputBufferSize - 1);
+    memcpy(_inputBuffer, _pollLine, len);
+    _inputBuffer[len] = '\0';
+
+    debugPrint("<< ");
+    debugPrintln(_inputBuffer);
+
+    return checkURC(_inputBuffer);
+}
+
+void Sodaq_Ublox::pollFinishLine()
+{
+    while (_pollLineLength > 0) {
+        pollAppend(timedRead(SODAQ_UBLOX_POLL_LINE_TIMEOUT));
+    }
+}
+
 void Sodaq_Ublox::writeProlog()
 {
     if (!_appendCommand) {
+        pollFinishLine();
+
         debugPrint(">> ");
         _appendCommand = true;
     }
@@ -685,6 +759,12 @@ size_t Sodaq_Ublox::writeByte(uint8_t value)
     return _modemUART->write(value);
 }
 
+// Write a buffer of bytes, as binary data
+size_t Sodaq_Ublox::writeBytes(const uint8_t* buffer, size_t size)
+{
+    return _modemUART->write(buffer, size);
+}
+
 size_t Sodaq_Ublox::print(const String& buffer)
 {
     writeProlog();
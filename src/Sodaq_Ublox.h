@@ -38,6 +38,12 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #define SODAQ_UBLOX_DEFAULT_RESPONSE_TIMEOUT    5000
 #define SODAQ_UBLOX_DEFAULT_SOCKET_TIMEOUT      15000
+#define SODAQ_UBLOX_POLL_LINE_TIMEOUT           250
+
+// The size of the line that poll() keeps between calls
+#ifndef SODAQ_UBLOX_POLL_LINE_SIZE
+#define SODAQ_UBLOX_POLL_LINE_SIZE              128
+#endif
 
 #define SODAQ_UBLOX_SOCKET_COUNT        7
 
@@ -179,6 +185,12 @@ public:
     bool    execCommand(const String& command, char* buffer, size_t size,
                         uint32_t timeout = SODAQ_UBLOX_DEFAULT_RESPONSE_TIMEOUT);
 
+    // Handles the URCs in all complete lines that are available from the modem
+    // UART, without waiting for more input. A partial line is kept for the next
+    // call, or completed before the UART is read for a command.
+    // Returns the number of handled URCs.
+    size_t  poll();
+
     // Sets the optional "Diagnostics and Debug" print.
     void setDiag(Print &print) { _diagPrint = &print; }
     void setDiag(Print *print) { _diagPrint = print; }
@@ -212,6 +224,8 @@ protected:
     void initBuffer();
 
     const char* getInputBuffer() const { return _inputBuffer; }
+    char* getInputBuffer() { return _inputBuffer; }
+    size_t getInputBufferSize() const { return _inputBufferSize; }
 
     bool waitForPrompt(char prompt, uint32_t timeout);
 
@@ -246,9 +260,20 @@ protected:
     // Write a byte
     size_t writeByte(uint8_t value);
 
+    // Write a buffer of bytes in one go, as binary data
+    size_t writeBytes(const uint8_t* buffer, size_t size);
+
     // Write the command prolog (just for debugging
     void writeProlog();
 
+    // Adds a character to the line of poll(), and handles the line when it is complete.
+    // A timeout (c < 0) ends the line. Returns true if the line was a URC.
+    bool pollAppend(int c);
+
+    // Handles the partial line of poll(), waiting up to SODAQ_UBLOX_POLL_LINE_TIMEOUT
+    // for the rest of it.
+    void pollFinishLine();
+
     size_t print(const __FlashStringHelper *);
     size_t print(const String &);
     size_t print(const char[]);
@@ -345,6 +370,10 @@ private:
     // The buffer used when reading from the modem. The space is allocated during init() via initBuffer().
     char* _inputBuffer;
 
+    // The partial line read by poll(), it is not in the input buffer so a reply cannot overwrite it
+    char _pollLine[SODAQ_UBLOX_POLL_LINE_SIZE];
+    size_t _pollLineLength;
+
     // This flag keeps track if the next write is the continuation of the current command
     // A Carriage Return will reset this flag.
     bool _appendCommand;